@@ -112,27 +112,47 @@ void dnxhd_10bit_get_pixels_8x4_sym(int16_t *av_restrict block,
     memcpy(block + 4 * 8, pixels + 3 * line_size, 8 * sizeof(*block));
 }
 
-static int dnxhd_10bit_dct_quantize(MpegEncContext *ctx, int16_t *block,
-                                    int n, int qscale, int *overflow)
+static void dnxhd_10bit_quantize_c(int16_t *dst, const int16_t *src,
+                                   const int *qmat)
 {
-    const uint8_t *scantable= ctx->intra_scantable.scantable;
-    const int *qmat = n<4 ? ctx->q_intra_matrix[qscale] : ctx->q_chroma_intra_matrix[qscale];
-    int last_non_zero = 0;
     int i;
 
+    dst[0] = src[0];
+    for (i = 1; i < 64; i++) {
+        int sign  = FF_SIGNBIT(src[i]);
+        int level = (src[i] ^ sign) - sign;
+        level  = level * qmat[i] >> DNX10BIT_QMAT_SHIFT;
+        dst[i] = (level ^ sign) - sign;
+    }
+}
+
+static void dnxhd_10bit_dct(MpegEncContext *ctx, int16_t *block)
+{
     ctx->fdsp.fdct(block);
 
     // Divide by 4 with rounding, to compensate scaling of DCT coefficients
     block[0] = (block[0] + 2) >> 2;
+}
+
+/**
+ * Quantise a block transformed by dnxhd_10bit_dct() into block.
+ */
+static int dnxhd_10bit_quantize(MpegEncContext *ctx, int16_t *block,
+                                const int16_t *coeffs, int n, int qscale)
+{
+    DNXHDEncContext *dctx = ctx->avctx->priv_data;
+    const uint8_t *scantable= ctx->intra_scantable.scantable;
+    const int *qmat = n<4 ? ctx->q_intra_matrix[qscale] : ctx->q_chroma_intra_matrix[qscale];
+    int last_non_zero = 0;
+    int i;
+
+    dctx->quantize_10bit(block, coeffs, qmat);
 
-    for (i = 1; i < 64; ++i) {
-        int j = scantable[i];
-        int sign = FF_SIGNBIT(block[j]);
-        int level = (block[j] ^ sign) - sign;
-        level = level * qmat[j] >> DNX10BIT_QMAT_SHIFT;
-        block[j] = (level ^ sign) - sign;
-        if (level)
+    for (i = 63; i > 0; i--) {
+        if (block[scantable[i]]) {
             last_non_zero = i;
+            break;
+        }
     }
 
     /* we need this permutation so that we correct the IDCT, we only permute the !=0 elements */
@@ -143,6 +163,13 @@ static int dnxhd_10bit_dct_quantize(MpegEncContext *ctx, int16_t *block,
     return last_non_zero;
 }
 
+static int dnxhd_10bit_dct_quantize(MpegEncContext *ctx, int16_t *block,
+                                    int n, int qscale, int *overflow)
+{
+    dnxhd_10bit_dct(ctx, block);
+    return dnxhd_10bit_quantize(ctx, block, block, n, qscale);
+}
+
 static av_cold int dnxhd_init_vlc(DNXHDEncContext *ctx)
 {
     int i, j, level, run;
@@ -288,7 +315,10 @@ static av_cold int dnxhd_init_rc(DNXHDEncContext *ctx)
 {
     FF_ALLOCZ_ARRAY_OR_GOTO(ctx->m.avctx, ctx->mb_rc, (ctx->m.avctx->qmax + 1),
                           ctx->m.mb_num * sizeof(RCEntry), fail);
-    if (ctx->m.avctx->mb_decision != FF_MB_DECISION_RD) {
+    if (ctx->m.avctx->mb_decision == FF_MB_DECISION_RD) {
+        FF_ALLOCZ_ARRAY_OR_GOTO(ctx->m.avctx, ctx->mb_rc_qmax,
+                          ctx->m.mb_num, sizeof(*ctx->mb_rc_qmax), fail);
+    } else {
         FF_ALLOCZ_ARRAY_OR_GOTO(ctx->m.avctx, ctx->mb_cmp,
                           ctx->m.mb_num, sizeof(RCCMPEntry), fail);
         FF_ALLOCZ_ARRAY_OR_GOTO(ctx->m.avctx, ctx->mb_cmp_tmp,
@@ -358,9 +388,17 @@ static av_cold int dnxhd_encode_init(AVCodecContext *avctx)
 
     ctx->cid_table = &ff_dnxhd_cid_table[index];
 
+    /* the mpegvideo trellis needs the MPEG AC VLC lengths and matrices */
+    if (avctx->trellis && ctx->cid_table->bit_depth == 8) {
+        av_log(avctx, AV_LOG_ERROR,
+               "Trellis quantization is not supported for 8-bit DNxHD\n");
+        return AVERROR_PATCHWELCOME;
+    }
+
     ctx->m.avctx    = avctx;
     ctx->m.mb_intra = 1;
     ctx->m.h263_aic = 1;
+    ctx->m.trellis  = avctx->trellis;
 
     avctx->bits_per_raw_sample = ctx->cid_table->bit_depth;
 
@@ -380,6 +418,7 @@ static av_cold int dnxhd_encode_init(AVCodecContext *avctx)
     if (ctx->cid_table->bit_depth == 10) {
         ctx->m.dct_quantize     = dnxhd_10bit_dct_quantize;
         ctx->get_pixels_8x4_sym = dnxhd_10bit_get_pixels_8x4_sym;
+        ctx->quantize_10bit     = dnxhd_10bit_quantize_c;
         ctx->block_width_l2     = 4;
     } else {
         ctx->get_pixels_8x4_sym = dnxhd_8bit_get_pixels_8x4_sym;
@@ -765,6 +804,90 @@ static int dnxhd_calc_bits_thread(AVCodecContext *avctx, void *arg,
     return 0;
 }
 
+/**
+ * Compute the bits and the distortion of a row of macroblocks for all the
+ * qscales. The blocks are loaded (and for 10-bit transformed) once per
+ * macroblock, and the DC coefficients do not depend on the qscale.
+ * For 10-bit, once a qscale leaves only the DC coefficients all larger ones
+ * code the macroblock the same way and are not computed, see mb_rc_qmax.
+ * The 8-bit 16-bit quantization matrices wrap for small qscales, so the
+ * quantization is not monotonic there and every qscale is computed.
+ */
+static int dnxhd_calc_bits_rdo_thread(AVCodecContext *avctx, void *arg,
+                                      int jobnr, int threadnr)
+{
+    DNXHDEncContext *ctx = avctx->priv_data;
+    int mb_y = jobnr, mb_x;
+    LOCAL_ALIGNED_16(int16_t, block, [64]);
+    LOCAL_ALIGNED_16(int16_t, coeffs, [8], [64]);
+    ctx = ctx->thread[threadnr];
+
+    ctx->m.last_dc[0] =
+    ctx->m.last_dc[1] =
+    ctx->m.last_dc[2] = 1 << (ctx->cid_table->bit_depth + 2);
+
+    for (mb_x = 0; mb_x < ctx->m.mb_width; mb_x++) {
+        unsigned mb = mb_y * ctx->m.mb_width + mb_x;
+        int dc_bits = 0;
+        int qscale, i;
+
+        dnxhd_get_blocks(ctx, mb_x, mb_y);
+
+        for (i = 0; i < 8; i++) {
+            memcpy(coeffs[i], ctx->blocks[i], 64 * sizeof(*block));
+            if (ctx->cid_table->bit_depth == 10)
+                dnxhd_10bit_dct(&ctx->m, coeffs[i]);
+        }
+
+        for (qscale = 1; qscale < avctx->qmax; qscale++) {
+            RCEntry *rc = &ctx->mb_rc[(qscale * ctx->m.mb_num) + mb];
+            int ssd     = 0;
+            int ac_bits = 0;
+            int dc_only = 1;
+
+            for (i = 0; i < 8; i++) {
+                int overflow, last_index;
+
+                if (ctx->cid_table->bit_depth == 10) {
+                    last_index = dnxhd_10bit_quantize(&ctx->m, block, coeffs[i],
+                                                      4 & (2*i), qscale);
+                } else {
+                    memcpy(block, coeffs[i], 64 * sizeof(*block));
+                    last_index = ctx->m.dct_quantize(&ctx->m, block, 4 & (2*i),
+                                                     qscale, &overflow);
+                }
+                ac_bits += dnxhd_calc_ac_bits(ctx, block, last_index);
+                dc_only &= !last_index;
+
+                if (qscale == 1) {
+                    int n = dnxhd_switch_matrix(ctx, i);
+                    int nbits, diff = block[0] - ctx->m.last_dc[n];
+
+                    if (diff < 0)
+                        nbits = av_log2_16bit(-2 * diff);
+                    else
+                        nbits = av_log2_16bit(2 * diff);
+
+                    av_assert1(nbits < ctx->cid_table->bit_depth + 4);
+                    dc_bits += ctx->cid_table->dc_bits[nbits] + nbits;
+
+                    ctx->m.last_dc[n] = block[0];
+                }
+
+                dnxhd_unquantize_c(ctx, block, i, qscale, last_index);
+                ctx->m.idsp.idct(block);
+                ssd += dnxhd_ssd_block(block, ctx->blocks[i]);
+            }
+            rc->ssd  = ssd;
+            rc->bits = ac_bits + dc_bits + 12 + 8 * ctx->vlc_bits[0];
+            if (dc_only && ctx->cid_table->bit_depth == 10)
+                break;
+        }
+        ctx->mb_rc_qmax[mb] = FFMIN(qscale, avctx->qmax - 1);
+    }
+    return 0;
+}
+
 static int dnxhd_encode_thread(AVCodecContext *avctx, void *arg,
                                int jobnr, int threadnr)
 {
@@ -895,11 +1018,8 @@ static int dnxhd_encode_rdo(AVCodecContext *avctx, DNXHDEncContext *ctx)
     int last_lower = INT_MAX, last_higher = 0;
     int x, y, q;
 
-    for (q = 1; q < avctx->qmax; q++) {
-        ctx->qscale = q;
-        avctx->execute2(avctx, dnxhd_calc_bits_thread,
-                        NULL, NULL, ctx->m.mb_height);
-    }
+    avctx->execute2(avctx, dnxhd_calc_bits_rdo_thread,
+                    NULL, NULL, ctx->m.mb_height);
     up_step = down_step = 2 << LAMBDA_FRAC_BITS;
     lambda  = ctx->lambda;
 
@@ -916,7 +1036,8 @@ static int dnxhd_encode_rdo(AVCodecContext *avctx, DNXHDEncContext *ctx)
                 int qscale = 1;
                 int mb     = y * ctx->m.mb_width + x;
                 int rc = 0;
-                for (q = 1; q < avctx->qmax; q++) {
+                // the larger qscales cannot score lower than mb_rc_qmax
+                for (q = 1; q <= ctx->mb_rc_qmax[mb]; q++) {
                     int i = (q*ctx->m.mb_num) + mb;
                     unsigned score = ctx->mb_rc[i].bits * lambda +
                                      ((unsigned) ctx->mb_rc[i].ssd << LAMBDA_FRAC_BITS);
@@ -1234,6 +1355,7 @@ static av_cold int dnxhd_encode_end(AVCodecContext *avctx)
     av_freep(&ctx->mb_bits);
     av_freep(&ctx->mb_qscale);
     av_freep(&ctx->mb_rc);
+    av_freep(&ctx->mb_rc_qmax);
     av_freep(&ctx->mb_cmp);
     av_freep(&ctx->mb_cmp_tmp);
     av_freep(&ctx->slice_size);
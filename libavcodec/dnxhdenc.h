@@ -94,6 +94,7 @@ typedef struct DNXHDEncContext {
 
     uint16_t *mb_bits;
     uint8_t  *mb_qscale;
+    uint16_t *mb_rc_qmax; ///< larger qscales code the macroblock like this one (DC only)
 
     RCCMPEntry *mb_cmp;
     RCCMPEntry *mb_cmp_tmp;
@@ -101,6 +102,12 @@ typedef struct DNXHDEncContext {
 
     void (*get_pixels_8x4_sym)(int16_t * /* align 16 */,
                                const uint8_t *, ptrdiff_t);
+    /**
+     * Quantise the AC coefficients of a transformed 10-bit block,
+     * the DC coefficient is copied.
+     */
+    void (*quantize_10bit)(int16_t *dst /* align 16 */,
+                           const int16_t *src /* align 16 */, const int *qmat);
 } DNXHDEncContext;
 
 void ff_dnxhdenc_init_x86(DNXHDEncContext *ctx);
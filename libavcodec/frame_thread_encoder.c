@@ -117,9 +117,21 @@ int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
 
 
     if(   !(avctx->thread_type & FF_THREAD_FRAME)
-       || !(avctx->codec->capabilities & AV_CODEC_CAP_INTRA_ONLY))
+       || !(avctx->codec->capabilities & AV_CODEC_CAP_INTRA_ONLY
+            || avctx->codec_id == AV_CODEC_ID_FFV1))
         return 0;
 
+    if (avctx->codec_id == AV_CODEC_ID_FFV1) {
+        // FFV1 only resets its context states on keyframes, so frames can be
+        // encoded independently only if every frame is a keyframe
+        if (avctx->gop_size > 1 || (avctx->flags & AV_CODEC_FLAG_PASS1)) {
+            av_log(avctx, AV_LOG_DEBUG,
+                   "Not using frame threads for FFV1 encoding with gop size > 1 "
+                   "or first pass, use -g 1 for frame threading\n");
+            return 0;
+        }
+    }
+
     if(   !avctx->thread_count
        && avctx->codec_id == AV_CODEC_ID_MJPEG
        && !(avctx->flags & AV_CODEC_FLAG_QSCALE)) {
@@ -174,6 +174,18 @@ typedef struct AVCodecInternal {
     AVFrame *buffer_frame;
     int draining_done;
     int showed_multi_packet_warning;
+
+    /**
+     * pool for the side data attached to the decoded frames, shared with
+     * the frame threads
+     */
+    AVFrameSideDataPool *side_data_pool;
+
+    /**
+     * Set by ff_alloc_packet_pool(), the encoded packet is backed by a pool
+     * buffer that must not be shrunk.
+     */
+    int pooled_packet;
 } AVCodecInternal;
 
 struct AVCodecDefault {
@@ -243,6 +255,36 @@ int ff_alloc_packet2(AVCodecContext *avctx, AVPacket *avpkt, int64_t size, int64
 
 attribute_deprecated int ff_alloc_packet(AVPacket *avpkt, int size);
 
+#define PACKET_POOL_MIN_BITS 12
+#define PACKET_POOL_CLASSES  19
+
+/**
+ * Buffers for the payload of encoded packets, see ff_alloc_packet_pool().
+ */
+typedef struct PacketPool {
+    /**
+     * One pool per size class, class i holds buffers of
+     * 1 << (PACKET_POOL_MIN_BITS + i) bytes, created on first use.
+     */
+    AVBufferPool *pools[PACKET_POOL_CLASSES];
+    unsigned nb_allocs; ///< number of buffers allocated by the pools so far
+} PacketPool;
+
+/**
+ * Like ff_alloc_packet2(), but take the payload of packets without user
+ * supplied data from the smallest size class of pool that fits size plus
+ * padding. The resulting packet is refcounted and avcodec_encode_video2()
+ * passes it on as is, without copying it out of the internal byte buffer
+ * or shrinking it. Since the classes are powers of two, each packet can
+ * keep up to twice its size alive until it is freed, and the pools keep
+ * the returned buffers until ff_packet_pool_uninit().
+ * Larger packets than the biggest class go through ff_alloc_packet2().
+ */
+int ff_alloc_packet_pool(AVCodecContext *avctx, AVPacket *avpkt,
+                         PacketPool *pool, int64_t size);
+
+void ff_packet_pool_uninit(PacketPool *pool);
+
 /**
  * Rescale from sample rate to AVCodecContext.time_base.
  */
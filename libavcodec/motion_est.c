@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
+#include <string.h>
 
 #include "avcodec.h"
 #include "internal.h"
@@ -335,21 +336,34 @@ FF_ENABLE_DEPRECATION_WARNINGS
 
     c->avctx= s->avctx;
 
+    c->me_cmp               = c->avctx->me_cmp;
+    c->me_sub_cmp           = c->avctx->me_sub_cmp;
+    c->mb_cmp               = c->avctx->mb_cmp;
+    c->subpel_quality       = c->avctx->me_subpel_quality;
+    c->last_predictor_count = c->avctx->last_predictor_count;
+    if (s->fast_first_pass) {
+        c->me_cmp               =
+        c->me_sub_cmp           =
+        c->mb_cmp               = FF_CMP_SAD;
+        c->subpel_quality       = FFMIN(c->subpel_quality, 2);
+        c->last_predictor_count = 0;
+    }
+
     if(s->codec_id == AV_CODEC_ID_H261)
-        c->avctx->me_sub_cmp = c->avctx->me_cmp;
+        c->me_sub_cmp = c->me_cmp;
 
     if(cache_size < 2*dia_size && !c->stride){
         av_log(s->avctx, AV_LOG_INFO, "ME_MAP size may be a little small for the selected diamond size\n");
     }
 
     ff_set_cmp(&s->mecc, s->mecc.me_pre_cmp, c->avctx->me_pre_cmp);
-    ff_set_cmp(&s->mecc, s->mecc.me_cmp,     c->avctx->me_cmp);
-    ff_set_cmp(&s->mecc, s->mecc.me_sub_cmp, c->avctx->me_sub_cmp);
-    ff_set_cmp(&s->mecc, s->mecc.mb_cmp,     c->avctx->mb_cmp);
+    ff_set_cmp(&s->mecc, s->mecc.me_cmp,     c->me_cmp);
+    ff_set_cmp(&s->mecc, s->mecc.me_sub_cmp, c->me_sub_cmp);
+    ff_set_cmp(&s->mecc, s->mecc.mb_cmp,     c->mb_cmp);
 
-    c->flags    = get_flags(c, 0, c->avctx->me_cmp    &FF_CMP_CHROMA);
-    c->sub_flags= get_flags(c, 0, c->avctx->me_sub_cmp&FF_CMP_CHROMA);
-    c->mb_flags = get_flags(c, 0, c->avctx->mb_cmp    &FF_CMP_CHROMA);
+    c->flags    = get_flags(c, 0, c->me_cmp    &FF_CMP_CHROMA);
+    c->sub_flags= get_flags(c, 0, c->me_sub_cmp&FF_CMP_CHROMA);
+    c->mb_flags = get_flags(c, 0, c->mb_cmp    &FF_CMP_CHROMA);
 
 /*FIXME s->no_rounding b_type*/
     if (s->avctx->flags & AV_CODEC_FLAG_QPEL) {
@@ -360,11 +374,11 @@ FF_ENABLE_DEPRECATION_WARNINGS
         else
             c->qpel_put = s->qdsp.put_qpel_pixels_tab;
     }else{
-        if(c->avctx->me_sub_cmp&FF_CMP_CHROMA)
+        if(c->me_sub_cmp&FF_CMP_CHROMA)
             c->sub_motion_search= hpel_motion_search;
-        else if(   c->avctx->me_sub_cmp == FF_CMP_SAD
-                && c->avctx->    me_cmp == FF_CMP_SAD
-                && c->avctx->    mb_cmp == FF_CMP_SAD)
+        else if(   c->me_sub_cmp == FF_CMP_SAD
+                && c->    me_cmp == FF_CMP_SAD
+                && c->    mb_cmp == FF_CMP_SAD)
             c->sub_motion_search= sad_hpel_motion_search; // 2050 vs. 2450 cycles
         else
             c->sub_motion_search= hpel_motion_search;
@@ -387,9 +401,9 @@ FF_ENABLE_DEPRECATION_WARNINGS
      * not have yet, and even if we had, the motion estimation code
      * does not expect it. */
     if (s->codec_id != AV_CODEC_ID_SNOW) {
-        if ((c->avctx->me_cmp & FF_CMP_CHROMA) /* && !s->mecc.me_cmp[2] */)
+        if ((c->me_cmp & FF_CMP_CHROMA) /* && !s->mecc.me_cmp[2] */)
             s->mecc.me_cmp[2] = zero_cmp;
-        if ((c->avctx->me_sub_cmp & FF_CMP_CHROMA) && !s->mecc.me_sub_cmp[2])
+        if ((c->me_sub_cmp & FF_CMP_CHROMA) && !s->mecc.me_sub_cmp[2])
             s->mecc.me_sub_cmp[2] = zero_cmp;
         c->hpel_put[2][0]= c->hpel_put[2][1]=
         c->hpel_put[2][2]= c->hpel_put[2][3]= zero_hpel;
@@ -706,7 +720,7 @@ static inline int h263_mv4_search(MpegEncContext *s, int mx, int my, int shift)
                                       c->scratchpad, stride, 16);
     }
 
-    if(c->avctx->mb_cmp&FF_CMP_CHROMA){
+    if(c->mb_cmp&FF_CMP_CHROMA){
         int dxy;
         int mx, my;
         int offset;
@@ -732,7 +746,7 @@ static inline int h263_mv4_search(MpegEncContext *s, int mx, int my, int shift)
     c->pred_x= mx;
     c->pred_y= my;
 
-    switch(c->avctx->mb_cmp&0xFF){
+    switch(c->mb_cmp&0xFF){
     /*case FF_CMP_SSE:
         return dmin_sum+ 32*s->qscale*s->qscale;*/
     case FF_CMP_RD:
@@ -867,7 +881,7 @@ static int interlaced_search(MpegEncContext *s, int ref_index,
     if(same)
         return INT_MAX;
 
-    switch(c->avctx->mb_cmp&0xFF){
+    switch(c->mb_cmp&0xFF){
     /*case FF_CMP_SSE:
         return dmin_sum+ 32*s->qscale*s->qscale;*/
     case FF_CMP_RD:
@@ -921,9 +935,9 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
     av_assert0(s->linesize == c->stride);
     av_assert0(s->uvlinesize == c->uvstride);
 
-    c->penalty_factor    = get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_cmp);
-    c->sub_penalty_factor= get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_sub_cmp);
-    c->mb_penalty_factor = get_penalty_factor(s->lambda, s->lambda2, c->avctx->mb_cmp);
+    c->penalty_factor    = get_penalty_factor(s->lambda, s->lambda2, c->me_cmp);
+    c->sub_penalty_factor= get_penalty_factor(s->lambda, s->lambda2, c->me_sub_cmp);
+    c->mb_penalty_factor = get_penalty_factor(s->lambda, s->lambda2, c->mb_cmp);
     c->current_mv_penalty= c->mv_penalty[s->f_code] + MAX_DMV;
 
     get_limits(s, 16*mb_x, 16*mb_y);
@@ -986,7 +1000,7 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
     pic->mc_mb_var[s->mb_stride * mb_y + mb_x] = (vard+128)>>8;
     c->mc_mb_var_sum_temp += (vard+128)>>8;
 
-    if (c->avctx->mb_decision > FF_MB_DECISION_SIMPLE) {
+    if (s->mb_decision > FF_MB_DECISION_SIMPLE) {
         int p_score= FFMIN(vard, varc-500+(s->lambda2>>FF_LAMBDA_SHIFT)*100);
         int i_score= varc-500+(s->lambda2>>FF_LAMBDA_SHIFT)*20;
         c->scene_change_score+= ff_sqrt(p_score) - ff_sqrt(i_score);
@@ -1022,7 +1036,7 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
         mb_type= CANDIDATE_MB_TYPE_INTER;
 
         dmin= c->sub_motion_search(s, &mx, &my, dmin, 0, 0, 0, 16);
-        if(c->avctx->me_sub_cmp != c->avctx->mb_cmp && !c->skip)
+        if(c->me_sub_cmp != c->mb_cmp && !c->skip)
             dmin= get_mb_score(s, mx, my, 0, 0, 0, 16, 1);
 
         if ((s->avctx->flags & AV_CODEC_FLAG_4MV)
@@ -1045,7 +1059,7 @@ void ff_estimate_p_frame_motion(MpegEncContext * s,
         set_p_mv_tables(s, mx, my, mb_type!=CANDIDATE_MB_TYPE_INTER4V);
 
         /* get intra luma score */
-        if((c->avctx->mb_cmp&0xFF)==FF_CMP_SSE){
+        if((c->mb_cmp&0xFF)==FF_CMP_SSE){
             intra_score= varc - 500;
         }else{
             unsigned mean = (sum+128)>>8;
@@ -1143,9 +1157,9 @@ static int estimate_motion_b(MpegEncContext *s, int mb_x, int mb_y,
     uint8_t * const mv_penalty= c->mv_penalty[f_code] + MAX_DMV;
     int mv_scale;
 
-    c->penalty_factor    = get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_cmp);
-    c->sub_penalty_factor= get_penalty_factor(s->lambda, s->lambda2, c->avctx->me_sub_cmp);
-    c->mb_penalty_factor = get_penalty_factor(s->lambda, s->lambda2, c->avctx->mb_cmp);
+    c->penalty_factor    = get_penalty_factor(s->lambda, s->lambda2, c->me_cmp);
+    c->sub_penalty_factor= get_penalty_factor(s->lambda, s->lambda2, c->me_sub_cmp);
+    c->mb_penalty_factor = get_penalty_factor(s->lambda, s->lambda2, c->mb_cmp);
     c->current_mv_penalty= mv_penalty;
 
     get_limits(s, 16*mb_x, 16*mb_y);
@@ -1183,7 +1197,7 @@ static int estimate_motion_b(MpegEncContext *s, int mb_x, int mb_y,
 
     dmin= c->sub_motion_search(s, &mx, &my, dmin, 0, ref_index, 0, 16);
 
-    if(c->avctx->me_sub_cmp != c->avctx->mb_cmp && !c->skip)
+    if(c->me_sub_cmp != c->mb_cmp && !c->skip)
         dmin= get_mb_score(s, mx, my, 0, ref_index, 0, 16, 1);
 
 //    s->mb_type[mb_y*s->mb_width + mb_x]= mb_type;
@@ -1250,7 +1264,7 @@ static inline int check_bidir_mv(MpegEncContext * s,
            +(mv_penalty_b[motion_bx-pred_bx] + mv_penalty_b[motion_by-pred_by])*c->mb_penalty_factor
            + s->mecc.mb_cmp[size](s, src_data[0], dest_y, stride, h); // FIXME new_pic
 
-    if(c->avctx->mb_cmp&FF_CMP_CHROMA){
+    if(c->mb_cmp&FF_CMP_CHROMA){
     }
     //FIXME CHROMA !!!
 
@@ -1494,7 +1508,7 @@ static inline int direct_search(MpegEncContext * s, int mb_x, int mb_y)
     else
         dmin = hpel_motion_search(s, &mx, &my, dmin, 0, 0, 0, 16);
 
-    if(c->avctx->me_sub_cmp != c->avctx->mb_cmp && !c->skip)
+    if(c->me_sub_cmp != c->mb_cmp && !c->skip)
         dmin= get_mb_score(s, mx, my, 0, 0, 0, 16, 1);
 
     get_limits(s, 16*mb_x, 16*mb_y); //restore c->?min/max, maybe not needed
@@ -1595,7 +1609,7 @@ void ff_estimate_b_frame_motion(MpegEncContext * s,
         s->current_picture.mc_mb_var[mb_y*s->mb_stride + mb_x] = score; //FIXME use SSE
     }
 
-    if(c->avctx->mb_decision > FF_MB_DECISION_SIMPLE){
+    if(s->mb_decision > FF_MB_DECISION_SIMPLE){
         type= CANDIDATE_MB_TYPE_FORWARD | CANDIDATE_MB_TYPE_BACKWARD | CANDIDATE_MB_TYPE_BIDIR | CANDIDATE_MB_TYPE_DIRECT;
         if(fimin < INT_MAX)
             type |= CANDIDATE_MB_TYPE_FORWARD_I;
@@ -1759,3 +1773,228 @@ void ff_fix_long_mvs(MpegEncContext * s, uint8_t *field_select_table, int field_
         }
     }
 }
+
+int ff_me_pyramid_init(MpegEncContext *s)
+{
+    MotionEstContext * const c = &s->me;
+    int l, i;
+
+    c->pyramid_levels = s->me_pyramid;
+    for (l = 0; l < c->pyramid_levels; l++) {
+        c->pyramid_bw[l]     = (s->mb_width  + (1 << l) - 1) >> l;
+        c->pyramid_bh[l]     = (s->mb_height + (1 << l) - 1) >> l;
+        c->pyramid_stride[l] = FFALIGN(8 * c->pyramid_bw[l], 32);
+
+        for (i = 0; i < 2; i++) {
+            c->pyramid[i][l] = av_malloc(c->pyramid_stride[l] * 8 * c->pyramid_bh[l]);
+            if (!c->pyramid[i][l])
+                return AVERROR(ENOMEM);
+        }
+        c->pyramid_mv[l] = av_mallocz_array(c->pyramid_bw[l] * c->pyramid_bh[l],
+                                            sizeof(*c->pyramid_mv[l]));
+        if (!c->pyramid_mv[l])
+            return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+void ff_me_pyramid_uninit(MotionEstContext *c)
+{
+    int l;
+
+    for (l = 0; l < ME_PYRAMID_MAX_LEVELS; l++) {
+        av_freep(&c->pyramid[0][l]);
+        av_freep(&c->pyramid[1][l]);
+        av_freep(&c->pyramid_mv[l]);
+    }
+    c->pyramid_levels    = 0;
+    c->pyramid_valid     = 0;
+    c->pyramid_ref_valid = 0;
+}
+
+/**
+ * Downscale src by 2 into level l and replicate the last column and row
+ * into the part of the plane not covered by the source.
+ */
+static void pyramid_build_level(MpegEncContext *s, uint8_t *dst, int l,
+                                const uint8_t *src, int src_stride,
+                                int src_w, int src_h)
+{
+    MotionEstContext * const c = &s->me;
+    const int stride = c->pyramid_stride[l];
+    const int w = src_w >> 1, h = src_h >> 1;
+    const int plane_w = 8 * c->pyramid_bw[l], plane_h = 8 * c->pyramid_bh[l];
+    int y;
+
+    s->mpvencdsp.shrink[1](dst, stride, src, src_stride, w, h);
+    if (w < plane_w) {
+        for (y = 0; y < h; y++)
+            memset(dst + y * stride + w, dst[y * stride + w - 1], plane_w - w);
+    }
+    for (y = h; y < plane_h; y++)
+        memcpy(dst + y * stride, dst + (h - 1) * stride, plane_w);
+}
+
+/**
+ * Score the vector (mx, my), clipped to [xmin, xmax] x [ymin, ymax], for
+ * the 8x8 block cur and keep it in best if it beats best_score.
+ */
+static av_always_inline void pyramid_check(MpegEncContext *s, const uint8_t *cur,
+                                           const uint8_t *ref, int stride,
+                                           int mx, int my,
+                                           int xmin, int xmax, int ymin, int ymax,
+                                           int best[2], int *best_score)
+{
+    int score;
+
+    mx = av_clip(mx, xmin, xmax);
+    my = av_clip(my, ymin, ymax);
+    if (mx == best[0] && my == best[1] && *best_score != INT_MAX)
+        return;
+
+    score = s->mecc.sad[1](s, (uint8_t *)cur, (uint8_t *)ref + my * stride + mx,
+                           stride, 8) +
+            4 * (FFABS(mx) + FFABS(my));
+    if (score < *best_score) {
+        *best_score = score;
+        best[0]     = mx;
+        best[1]     = my;
+    }
+}
+
+/**
+ * Predictive search of the coarsest level. Each block starts from the best
+ * of the zero vector, its already searched left, top and top-right
+ * neighbours, and the vectors it and its right and lower neighbours got in
+ * the previous P-frame, which are still in the table. A small diamond walk
+ * then follows the motion up to range pixels of the level.
+ */
+static void pyramid_search_coarse(MpegEncContext *s, int range)
+{
+    MotionEstContext * const c = &s->me;
+    const int l      = c->pyramid_levels - 1;
+    const int stride = c->pyramid_stride[l];
+    const int bw     = c->pyramid_bw[l];
+    const int bh     = c->pyramid_bh[l];
+    int16_t (*mv)[2] = c->pyramid_mv[l];
+    int bx, by, i;
+
+    for (by = 0; by < bh; by++) {
+        for (bx = 0; bx < bw; bx++) {
+            const int x = 8 * bx, y = 8 * by, xy = bx + by * bw;
+            const uint8_t *cur = c->pyramid[0][l] + y * stride + x;
+            const uint8_t *ref = c->pyramid[1][l] + y * stride + x;
+            const int xmin = FFMAX(-range, -x), xmax = FFMIN(range, 8 * bw - 8 - x);
+            const int ymin = FFMAX(-range, -y), ymax = FFMIN(range, 8 * bh - 8 - y);
+            int best[2] = { 0, 0 }, best_score = INT_MAX;
+
+#define CHECK(mx, my) pyramid_check(s, cur, ref, stride, mx, my, \
+                                    xmin, xmax, ymin, ymax, best, &best_score)
+            CHECK(0, 0);
+            CHECK(mv[xy][0], mv[xy][1]);
+            if (bx > 0)
+                CHECK(mv[xy - 1][0], mv[xy - 1][1]);
+            if (by > 0) {
+                CHECK(mv[xy - bw][0], mv[xy - bw][1]);
+                if (bx + 1 < bw)
+                    CHECK(mv[xy - bw + 1][0], mv[xy - bw + 1][1]);
+            }
+            if (bx + 1 < bw)
+                CHECK(mv[xy + 1][0], mv[xy + 1][1]);
+            if (by + 1 < bh)
+                CHECK(mv[xy + bw][0], mv[xy + bw][1]);
+
+            for (i = 0; i < range; i++) {
+                const int cx = best[0], cy = best[1];
+                CHECK(cx - 1, cy);
+                CHECK(cx + 1, cy);
+                CHECK(cx, cy - 1);
+                CHECK(cx, cy + 1);
+                if (best[0] == cx && best[1] == cy)
+                    break;
+            }
+#undef CHECK
+
+            mv[xy][0] = best[0];
+            mv[xy][1] = best[1];
+        }
+    }
+}
+
+/**
+ * Refine the vectors of one row of a finer level within +-1 of the scaled
+ * vector of the parent block, the zero vector is checked as well.
+ */
+static int pyramid_search_row(AVCodecContext *avctx, void *arg,
+                              int by, int threadnr)
+{
+    MpegEncContext *s = avctx->priv_data;
+    MotionEstContext * const c = &s->me;
+    const int l      = *(const int *)arg;
+    const int stride = c->pyramid_stride[l];
+    const int bw     = c->pyramid_bw[l];
+    const int xmax0  = 8 * bw - 8;
+    const int ymax0  = 8 * c->pyramid_bh[l] - 8;
+    int bx, dx, dy;
+
+    for (bx = 0; bx < bw; bx++) {
+        const int x = 8 * bx, y = 8 * by;
+        const uint8_t *cur = c->pyramid[0][l] + y * stride + x;
+        const uint8_t *ref = c->pyramid[1][l] + y * stride + x;
+        const int16_t *parent = c->pyramid_mv[l + 1][(bx >> 1) + (by >> 1) * c->pyramid_bw[l + 1]];
+        int best[2] = { 0, 0 }, best_score = INT_MAX;
+
+        pyramid_check(s, cur, ref, stride, 0, 0, -x, xmax0 - x, -y, ymax0 - y,
+                      best, &best_score);
+        for (dy = -1; dy <= 1; dy++)
+            for (dx = -1; dx <= 1; dx++)
+                pyramid_check(s, cur, ref, stride,
+                              2 * parent[0] + dx, 2 * parent[1] + dy,
+                              -x, xmax0 - x, -y, ymax0 - y, best, &best_score);
+
+        c->pyramid_mv[l][bx + by * bw][0] = best[0];
+        c->pyramid_mv[l][bx + by * bw][1] = best[1];
+    }
+
+    /* this runs on the slice threads, the SAD functions may use MMX */
+    emms_c();
+    return 0;
+}
+
+void ff_me_pyramid_search(MpegEncContext *s)
+{
+    MotionEstContext * const c = &s->me;
+    const int range = s->avctx->me_range ? s->avctx->me_range : 64;
+    int l;
+
+    c->pyramid_valid = 0;
+    if (!c->pyramid_levels || s->pict_type == AV_PICTURE_TYPE_B)
+        return;
+
+    /* Every anchor picture is downscaled once. Its levels are searched
+     * now and become the reference of the next P-frame; downscaling the
+     * source rather than the reconstruction is accurate enough for the
+     * seed vectors. */
+    for (l = 0; l < c->pyramid_levels; l++) {
+        if (!l)
+            pyramid_build_level(s, c->pyramid[0][0], 0, s->new_picture.f->data[0],
+                                s->linesize, 16 * s->mb_width, 16 * s->mb_height);
+        else
+            pyramid_build_level(s, c->pyramid[0][l], l, c->pyramid[0][l - 1],
+                                c->pyramid_stride[l - 1],
+                                8 * s->mb_width >> (l - 1), 8 * s->mb_height >> (l - 1));
+    }
+
+    if (s->pict_type == AV_PICTURE_TYPE_P && c->pyramid_ref_valid) {
+        pyramid_search_coarse(s, FFMAX(range >> c->pyramid_levels, 1));
+        for (l = c->pyramid_levels - 2; l >= 0; l--)
+            s->avctx->execute2(s->avctx, pyramid_search_row, &l, NULL,
+                               c->pyramid_bh[l]);
+        c->pyramid_valid = 1;
+    }
+    emms_c();
+
+    for (l = 0; l < c->pyramid_levels; l++)
+        FFSWAP(uint8_t *, c->pyramid[0][l], c->pyramid[1][l]);
+    c->pyramid_ref_valid = 1;
+}
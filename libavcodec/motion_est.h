@@ -41,6 +41,8 @@ struct MpegEncContext;
 #define FF_ME_EPZS 1
 #define FF_ME_XONE 2
 
+#define ME_PYRAMID_MAX_LEVELS 2
+
 /**
  * Motion estimation context.
  */
@@ -69,6 +71,11 @@ typedef struct MotionEstContext {
     int flags;
     int sub_flags;
     int mb_flags;
+    int me_cmp;                     ///< comparison functions used by the search,
+    int me_sub_cmp;                 ///< taken from avctx by ff_init_me() unless
+    int mb_cmp;                     ///< a fast first pass overrides them
+    int subpel_quality;
+    int last_predictor_count;
     int pre_pass;                   ///< = 1 for the pre pass
     int dia_size;
     int xmin;
@@ -86,6 +93,16 @@ typedef struct MotionEstContext {
     int64_t mb_var_sum_temp;
     int scene_change_score;
 
+    /* hierarchical search on downscaled luma, seeds the full resolution search */
+    int pyramid_levels;             ///< number of 2:1 downscaled levels, 0 if disabled
+    int pyramid_valid;              ///< pyramid_mv[0] holds vectors for the current picture
+    int pyramid_ref_valid;          ///< pyramid[1] holds the previous anchor picture
+    uint8_t *pyramid[2][ME_PYRAMID_MAX_LEVELS]; ///< current [0] and previous [1] anchor picture luma per level
+    int pyramid_stride[ME_PYRAMID_MAX_LEVELS];
+    int pyramid_bw[ME_PYRAMID_MAX_LEVELS];      ///< width of each level in 8x8 blocks
+    int pyramid_bh[ME_PYRAMID_MAX_LEVELS];      ///< height of each level in 8x8 blocks
+    int16_t (*pyramid_mv[ME_PYRAMID_MAX_LEVELS])[2]; ///< best vector per block, in pixels of its level
+
     op_pixels_func(*hpel_put)[4];
     op_pixels_func(*hpel_avg)[4];
     qpel_mc_func(*qpel_put)[16];
@@ -110,6 +127,17 @@ static inline int ff_h263_round_chroma(int x)
 
 int ff_init_me(struct MpegEncContext *s);
 
+int ff_me_pyramid_init(struct MpegEncContext *s);
+void ff_me_pyramid_uninit(MotionEstContext *c);
+
+/**
+ * Downscale the current anchor picture and, for a P-frame, run the
+ * hierarchical search against the previous one. Sets pyramid_valid so
+ * that the EPZS search of every macroblock gets the resulting vector as
+ * an additional candidate.
+ */
+void ff_me_pyramid_search(struct MpegEncContext *s);
+
 void ff_estimate_p_frame_motion(struct MpegEncContext *s, int mb_x, int mb_y);
 void ff_estimate_b_frame_motion(struct MpegEncContext *s, int mb_x, int mb_y);
 
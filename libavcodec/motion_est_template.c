@@ -73,7 +73,7 @@ static int hpel_motion_search(MpegEncContext * s,
         return dmin;
     }
 
-    if(c->avctx->me_cmp != c->avctx->me_sub_cmp){
+    if(c->me_cmp != c->me_sub_cmp){
         dmin= cmp(s, mx, my, 0, 0, size, h, ref_index, src_index, cmp_sub, chroma_cmp_sub, flags);
         if(mx || my || size>0)
             dmin += (mv_penalty[2*mx - pred_x] + mv_penalty[2*my - pred_y])*penalty_factor;
@@ -214,7 +214,7 @@ static int qpel_motion_search(MpegEncContext * s,
     const int my = *my_ptr;
     const int penalty_factor= c->sub_penalty_factor;
     const unsigned map_generation = c->map_generation;
-    const int subpel_quality= c->avctx->me_subpel_quality;
+    const int subpel_quality= c->subpel_quality;
     uint32_t *map= c->map;
     me_cmp_func cmpf, chroma_cmpf;
     me_cmp_func cmp_sub, chroma_cmp_sub;
@@ -235,7 +235,7 @@ static int qpel_motion_search(MpegEncContext * s,
         return dmin;
     }
 
-    if(c->avctx->me_cmp != c->avctx->me_sub_cmp){
+    if(c->me_cmp != c->me_sub_cmp){
         dmin= cmp(s, mx, my, 0, 0, size, h, ref_index, src_index, cmp_sub, chroma_cmp_sub, flags);
         if(mx || my || size>0)
             dmin += (mv_penalty[4*mx - pred_x] + mv_penalty[4*my - pred_y])*penalty_factor;
@@ -873,6 +873,7 @@ static av_always_inline int epzs_motion_search_internal(MpegEncContext * s, int
     const int ref_mv_stride= s->mb_stride; //pass as arg  FIXME
     const int ref_mv_xy = s->mb_x + s->mb_y * ref_mv_stride; // add to last_mv before passing FIXME
     me_cmp_func cmpf, chroma_cmpf;
+    int pyramid_mv[2] = { INT_MAX, INT_MAX };
 
     LOAD_COMMON
     LOAD_COMMON2
@@ -941,8 +942,15 @@ static av_always_inline int epzs_motion_search_internal(MpegEncContext * s, int
         }
     }
 
-    if(c->avctx->last_predictor_count){
-        const int count= c->avctx->last_predictor_count;
+    if (c->pyramid_valid && !c->pre_pass && size == 0 && h == 16) {
+        const int16_t *mv = c->pyramid_mv[0][s->mb_x + s->mb_y * c->pyramid_bw[0]];
+        pyramid_mv[0] = av_clip(2 * mv[0], xmin, xmax);
+        pyramid_mv[1] = av_clip(2 * mv[1], ymin, ymax);
+        CHECK_MV(pyramid_mv[0], pyramid_mv[1])
+    }
+
+    if(c->last_predictor_count){
+        const int count= c->last_predictor_count;
         const int xstart= FFMAX(0, s->mb_x - count);
         const int ystart= FFMAX(0, s->mb_y - count);
         const int xend= FFMIN(s->mb_width , s->mb_x + count + 1);
@@ -963,7 +971,11 @@ static av_always_inline int epzs_motion_search_internal(MpegEncContext * s, int
     }
 
 //check(best[0],best[1],0, b0)
-    dmin= diamond_search(s, best, dmin, src_index, ref_index, penalty_factor, size, h, flags);
+    /* the pyramid already searched wide, so only refine its vector locally */
+    if (best[0] == pyramid_mv[0] && best[1] == pyramid_mv[1])
+        dmin= small_diamond_search(s, best, dmin, src_index, ref_index, penalty_factor, size, h, flags);
+    else
+        dmin= diamond_search(s, best, dmin, src_index, ref_index, penalty_factor, size, h, flags);
 
 //check(best[0],best[1],0, b1)
     *mx_ptr= best[0];
@@ -82,6 +82,10 @@ typedef struct Picture {
     int64_t mc_mb_var_sum;      ///< motion compensated MB variance for current frame
 
     int b_frame_score;
+
+    int64_t la_mb_var_sum;      ///< lookahead estimate of mb_var_sum
+    int64_t la_mc_mb_var_sum;   ///< lookahead estimate of mc_mb_var_sum, without motion compensation
+    int la_scenecut;            ///< lookahead found a scene change at this picture
     int needs_realloc;          ///< Picture needs to be reallocated (eg due to a frame size change)
 
     int reference;
@@ -151,6 +151,7 @@ typedef struct MpegEncContext {
     int end_mb_y;              ///< end   mb_y of this thread (so current thread should process start_mb_y <= row < end_mb_y)
     struct MpegEncContext *thread_context[MAX_THREADS];
     int slice_context_count;   ///< number of used thread_contexts
+    struct MERowContext *me_rows; ///< row based motion estimation scheduling, encoder only
 
     /**
      * copy of the previous picture structure.
@@ -258,6 +259,7 @@ typedef struct MpegEncContext {
     int motion_est;                      ///< ME algorithm
     int me_penalty_compensation;
     int me_pre;                          ///< prepass for motion estimation
+    int me_pyramid;                      ///< levels of the hierarchical motion search
     int mv_dir;
 #define MV_DIR_FORWARD   1
 #define MV_DIR_BACKWARD  2
@@ -537,6 +539,11 @@ typedef struct MpegEncContext {
     float border_masking;
     int lmin, lmax;
     int vbv_ignore_qmax;
+    int rc_lookahead;               ///< number of frames analysed ahead of the ones being coded
+    int fast_first_pass;            ///< use cheap decisions in the first pass, cleared in other passes
+    int mb_decision;                ///< avctx->mb_decision, simple in a fast first pass
+    int trellis;                    ///< avctx->trellis, 0 in a fast first pass
+    int64_t *la_row_stats;          ///< per macroblock row results of the lookahead analysis
 
     char *rc_eq;
 
@@ -553,6 +560,8 @@ typedef struct MpegEncContext {
 
     /* temporary frames used by b_frame_strategy = 2 */
     AVFrame *tmp_frames[MAX_B_FRAMES + 2];
+    int tmp_frames_pic_num[MAX_B_FRAMES + 2]; ///< display_picture_number of the source of each tmp_frame, -1 if none
+    AVCodecContext *b_count_ctx[MAX_B_FRAMES + 1]; ///< trial encoder of each B-frame count candidate
     int b_frame_strategy;
     int b_sensitivity;
 
@@ -627,6 +636,8 @@ FF_MPV_OPT_CMP_FUNC, \
           "fCode iCount mcVar var isI isP isB avgQP qComp avgIITex avgPITex avgPPTex avgBPTex avgTex.",                                                                         \
                                                                     FF_MPV_OFFSET(rc_eq), AV_OPT_TYPE_STRING,                           .flags = FF_MPV_OPT_FLAGS },            \
 {"rc_init_cplx", "initial complexity for 1-pass encoding",          FF_MPV_OFFSET(rc_initial_cplx), AV_OPT_TYPE_FLOAT, {.dbl = 0 }, -FLT_MAX, FLT_MAX, FF_MPV_OPT_FLAGS},       \
+{"rc_lookahead", "Number of frames to analyse ahead for scene cuts and VBV planning", FF_MPV_OFFSET(rc_lookahead), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, MAX_B_FRAMES, FF_MPV_OPT_FLAGS }, \
+{"fastfirstpass", "Use fast motion estimation and mode decision in the first pass", FF_MPV_OFFSET(fast_first_pass), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, FF_MPV_OPT_FLAGS }, \
 {"rc_buf_aggressivity", "currently useless",                        FF_MPV_OFFSET(rc_buffer_aggressivity), AV_OPT_TYPE_FLOAT, {.dbl = 1.0 }, -FLT_MAX, FLT_MAX, FF_MPV_OPT_FLAGS}, \
 {"border_mask", "increase the quantizer for macroblocks close to borders", FF_MPV_OFFSET(border_masking), AV_OPT_TYPE_FLOAT, {.dbl = 0 }, -FLT_MAX, FLT_MAX, FF_MPV_OPT_FLAGS},    \
 {"lmin", "minimum Lagrange factor (VBR)",                           FF_MPV_OFFSET(lmin), AV_OPT_TYPE_INT, {.i64 =  2*FF_QP2LAMBDA }, 0, INT_MAX, FF_MPV_OPT_FLAGS },            \
@@ -654,6 +665,7 @@ FF_MPV_OPT_CMP_FUNC, \
 {"ps", "RTP payload size in bytes",                             FF_MPV_OFFSET(rtp_payload_size), AV_OPT_TYPE_INT, {.i64 = 0 }, INT_MIN, INT_MAX, FF_MPV_OPT_FLAGS }, \
 {"mepc", "Motion estimation bitrate penalty compensation (1.0 = 256)", FF_MPV_OFFSET(me_penalty_compensation), AV_OPT_TYPE_INT, {.i64 = 256 }, INT_MIN, INT_MAX, FF_MPV_OPT_FLAGS }, \
 {"mepre", "pre motion estimation", FF_MPV_OFFSET(me_pre), AV_OPT_TYPE_INT, {.i64 = 0 }, INT_MIN, INT_MAX, FF_MPV_OPT_FLAGS }, \
+{"me_pyramid", "Downscaled levels of a hierarchical search seeding the motion estimation", FF_MPV_OFFSET(me_pyramid), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, ME_PYRAMID_MAX_LEVELS, FF_MPV_OPT_FLAGS }, \
 
 extern const AVOption ff_mpv_generic_options[];
 
@@ -38,6 +38,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/timer.h"
 #include "avcodec.h"
 #include "dct.h"
@@ -77,6 +78,10 @@ static int dct_quantize_refine(MpegEncContext *s, int16_t *block, int16_t *weigh
 static int sse_mb(MpegEncContext *s);
 static void denoise_dct_c(MpegEncContext *s, int16_t *block);
 static int dct_quantize_trellis_c(MpegEncContext *s, int16_t *block, int n, int qscale, int *overflow);
+#if HAVE_THREADS
+static int me_rows_init(MpegEncContext *s);
+static void me_rows_uninit(MpegEncContext *s);
+#endif
 
 static uint8_t default_mv_penalty[MAX_FCODE + 1][MAX_DMV * 2 + 1];
 static uint8_t default_fcode_tab[MAX_MV * 2 + 1];
@@ -276,7 +281,7 @@ av_cold int ff_dct_encode_init(MpegEncContext *s) {
     if (!s->denoise_dct)
         s->denoise_dct  = denoise_dct_c;
     s->fast_dct_quantize = s->dct_quantize;
-    if (s->avctx->trellis)
+    if (s->trellis)
         s->dct_quantize  = dct_quantize_trellis_c;
 
     return 0;
@@ -360,6 +365,22 @@ FF_DISABLE_DEPRECATION_WARNINGS
 FF_ENABLE_DEPRECATION_WARNINGS
 #endif
 
+    s->mb_decision = avctx->mb_decision;
+    s->trellis     = avctx->trellis;
+    if (s->fast_first_pass && (avctx->flags & AV_CODEC_FLAG_PASS1) &&
+        !(avctx->flags & AV_CODEC_FLAG_PASS2)) {
+        /* the first pass only has to measure the complexity of the frames,
+         * the frame types are still decided as configured; ff_init_me()
+         * switches the motion search to SAD */
+        s->mb_decision              = FF_MB_DECISION_SIMPLE;
+        s->trellis                  = 0;
+        s->quantizer_noise_shaping  = 0;
+        s->mpv_flags &= ~(FF_MPV_FLAG_QP_RD | FF_MPV_FLAG_CBP_RD |
+                          FF_MPV_FLAG_SKIP_RD | FF_MPV_FLAG_MV0);
+        s->me_pyramid               = 0;
+    } else
+        s->fast_first_pass = 0;
+
     s->bit_rate = avctx->bit_rate;
     s->width    = avctx->width;
     s->height   = avctx->height;
@@ -378,6 +399,11 @@ FF_ENABLE_DEPRECATION_WARNINGS
         avctx->max_b_frames = MAX_B_FRAMES;
     }
     s->max_b_frames = avctx->max_b_frames;
+    if (s->rc_lookahead + s->max_b_frames > MAX_B_FRAMES) {
+        av_log(avctx, AV_LOG_ERROR, "rc_lookahead + max_b_frames must not "
+               "exceed %d.\n", MAX_B_FRAMES);
+        return AVERROR(EINVAL);
+    }
     s->codec_id     = avctx->codec->id;
     s->strict_std_compliance = avctx->strict_std_compliance;
     s->quarter_sample     = (avctx->flags & AV_CODEC_FLAG_QPEL) != 0;
@@ -909,6 +935,9 @@ FF_ENABLE_DEPRECATION_WARNINGS
     FF_ENABLE_DEPRECATION_WARNINGS
 #endif
 
+    /* the lookahead queue sits in front of the B-frame reordering */
+    avctx->delay += s->rc_lookahead;
+
     avctx->has_b_frames = !s->low_delay;
 
     s->encoding = 1;
@@ -946,6 +975,16 @@ FF_ENABLE_DEPRECATION_WARNINGS
                       MAX_PICTURE_COUNT * sizeof(Picture *), fail);
     FF_ALLOCZ_OR_GOTO(s->avctx, s->reordered_input_picture,
                       MAX_PICTURE_COUNT * sizeof(Picture *), fail);
+    if (s->rc_lookahead) {
+        FF_ALLOCZ_OR_GOTO(s->avctx, s->la_row_stats,
+                          3 * s->mb_height * sizeof(*s->la_row_stats), fail);
+    }
+    if (s->me_pyramid && ff_me_pyramid_init(s) < 0)
+        goto fail;
+#if HAVE_THREADS
+    if (me_rows_init(s) < 0)
+        goto fail;
+#endif
 
 
     if (s->noise_reduction) {
@@ -1093,6 +1132,8 @@ FF_ENABLE_DEPRECATION_WARNINGS
             if (!s->tmp_frames[i])
                 return AVERROR(ENOMEM);
 
+            s->tmp_frames_pic_num[i] = -1;
+
             s->tmp_frames[i]->format = AV_PIX_FMT_YUV420P;
             s->tmp_frames[i]->width  = s->width  >> s->brd_scale;
             s->tmp_frames[i]->height = s->height >> s->brd_scale;
@@ -1133,6 +1174,8 @@ av_cold int ff_mpv_encode_end(AVCodecContext *avctx)
 
     for (i = 0; i < FF_ARRAY_ELEMS(s->tmp_frames); i++)
         av_frame_free(&s->tmp_frames[i]);
+    for (i = 0; i < FF_ARRAY_ELEMS(s->b_count_ctx); i++)
+        avcodec_free_context(&s->b_count_ctx[i]);
 
     ff_free_picture_tables(&s->new_picture);
     ff_mpeg_unref_picture(s->avctx, &s->new_picture);
@@ -1150,6 +1193,11 @@ av_cold int ff_mpv_encode_end(AVCodecContext *avctx)
     av_freep(&s->q_inter_matrix16);
     av_freep(&s->input_picture);
     av_freep(&s->reordered_input_picture);
+    av_freep(&s->la_row_stats);
+    ff_me_pyramid_uninit(&s->me);
+#if HAVE_THREADS
+    me_rows_uninit(s);
+#endif
     av_freep(&s->dct_offset);
 
     return 0;
@@ -1192,6 +1240,85 @@ static int get_intra_count(MpegEncContext *s, uint8_t *src,
     return acc;
 }
 
+typedef struct LookaheadJob {
+    uint8_t *cur, *ref;
+} LookaheadJob;
+
+static uint8_t *input_picture_luma(MpegEncContext *s, Picture *pic)
+{
+    /* see load_input_picture() */
+    if (!pic->shared && !s->avctx->rc_buffer_size)
+        return pic->f->data[0] + INPLACE_OFFSET;
+    return pic->f->data[0];
+}
+
+static int lookahead_analyze_row(AVCodecContext *avctx, void *arg,
+                                 int mb_y, int threadnr)
+{
+    MpegEncContext *s      = avctx->priv_data;
+    const LookaheadJob *la = arg;
+    int64_t *stats         = s->la_row_stats + 3 * mb_y;
+    int mb_x;
+
+    stats[0] = stats[1] = stats[2] = 0;
+    for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
+        int offset   = 16 * (mb_x + mb_y * s->linesize);
+        uint8_t *pix = la->cur + offset;
+        int sum      = s->mpvencdsp.pix_sum(pix, s->linesize);
+        int varc     = (s->mpvencdsp.pix_norm1(pix, s->linesize) -
+                        (((unsigned) sum * sum) >> 8) + 500 + 128) >> 8;
+        int vard;
+
+        stats[0] += varc;
+        if (!la->ref)
+            continue;
+
+        /* zero motion only, the real search happens when the frame is coded */
+        vard = (s->mecc.sse[0](NULL, pix, la->ref + offset, s->linesize, 16) + 128) >> 8;
+        stats[1] += FFMIN(varc, vard);
+        stats[2] += vard > 2 * varc;
+    }
+    return 0;
+}
+
+/**
+ * Cheap pre-analysis of a picture entering the lookahead queue.
+ * The variance sums use the units of the ones computed during motion
+ * estimation, so the rate control can feed them to the same predictors.
+ */
+static void lookahead_analyze(MpegEncContext *s, Picture *pic, Picture *prev)
+{
+    LookaheadJob la = {
+        .cur = input_picture_luma(s, pic),
+        .ref = prev ? input_picture_luma(s, prev) : NULL,
+    };
+    int64_t intra_count = 0;
+    int mb_y;
+
+    s->avctx->execute2(s->avctx, lookahead_analyze_row, &la, NULL, s->mb_height);
+
+    pic->la_mb_var_sum    = 0;
+    pic->la_mc_mb_var_sum = 0;
+    for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
+        pic->la_mb_var_sum    += s->la_row_stats[3 * mb_y    ];
+        pic->la_mc_mb_var_sum += s->la_row_stats[3 * mb_y + 1];
+        intra_count           += s->la_row_stats[3 * mb_y + 2];
+    }
+    if (!prev) {
+        pic->la_mc_mb_var_sum = pic->la_mb_var_sum;
+        return;
+    }
+
+    /* most of the picture cannot be predicted from the previous one:
+     * make it a keyframe before the B-frame decision can bury it */
+    if (intra_count > s->mb_num * 3 / 4 &&
+        s->scenechange_threshold < 1000000000) {
+        pic->la_scenecut = 1;
+        if (pic->f->pict_type == AV_PICTURE_TYPE_NONE)
+            pic->f->pict_type = AV_PICTURE_TYPE_I;
+    }
+}
+
 static int alloc_picture(MpegEncContext *s, Picture *pic, int shared)
 {
     return ff_alloc_picture(s->avctx, pic, &s->me, &s->sc, shared, 1,
@@ -1205,8 +1332,9 @@ static int load_input_picture(MpegEncContext *s, const AVFrame *pic_arg)
     Picture *pic = NULL;
     int64_t pts;
     int i, display_picture_number = 0, ret;
-    int encoding_delay = s->max_b_frames ? s->max_b_frames
-                                         : (s->low_delay ? 0 : 1);
+    int encoding_delay = (s->max_b_frames ? s->max_b_frames
+                                          : (s->low_delay ? 0 : 1)) +
+                         s->rc_lookahead;
     int flush_offset = 1;
     int direct = 1;
 
@@ -1348,6 +1476,9 @@ static int load_input_picture(MpegEncContext *s, const AVFrame *pic_arg)
 
     s->input_picture[encoding_delay] = (Picture*) pic;
 
+    if (pic && s->rc_lookahead && !(s->avctx->flags & AV_CODEC_FLAG_PASS2))
+        lookahead_analyze(s, pic, encoding_delay ? s->input_picture[encoding_delay - 1] : NULL);
+
     return 0;
 }
 
@@ -1407,17 +1538,141 @@ static int encode_frame(AVCodecContext *c, AVFrame *frame)
     return ret;
 }
 
+typedef struct BCountEstimate {
+    AVCodecContext *c;
+    int b_count;
+    int p_lambda, b_lambda, lambda2;
+    int64_t rd;
+} BCountEstimate;
+
+/**
+ * Clear the motion vector tables a trial encoder kept from its previous
+ * window, so that stale vectors are not used as motion search predictors
+ * and every decision starts out like a freshly opened encoder.
+ */
+static void reset_b_count_context(AVCodecContext *c)
+{
+    MpegEncContext *t = c->priv_data;
+    const size_t size = ((t->mb_height + 2) * t->mb_stride + 1) *
+                        2 * sizeof(int16_t);
+
+    memset(t->p_mv_table_base,            0, size);
+    memset(t->b_forw_mv_table_base,       0, size);
+    memset(t->b_back_mv_table_base,       0, size);
+    memset(t->b_bidir_forw_mv_table_base, 0, size);
+    memset(t->b_bidir_back_mv_table_base, 0, size);
+    memset(t->b_direct_mv_table_base,     0, size);
+}
+
+/**
+ * Open the trial encoder of the B-frame count candidate idx on first use.
+ * The trial encoders are flushed after every decision and start each trial
+ * with a forced I-frame, so they are kept open until the encoder is closed.
+ */
+static int open_b_count_context(MpegEncContext *s, int idx)
+{
+    AVCodecContext *avctx = s->avctx;
+    AVCodecContext *c;
+    int ret;
+
+    if (s->b_count_ctx[idx])
+        return 0;
+
+    c = s->b_count_ctx[idx] = avcodec_alloc_context3(NULL);
+    if (!c)
+        return AVERROR(ENOMEM);
+
+    c->width        = s->width  >> s->brd_scale;
+    c->height       = s->height >> s->brd_scale;
+    c->flags        = AV_CODEC_FLAG_QSCALE | AV_CODEC_FLAG_PSNR;
+    c->flags       |= avctx->flags & AV_CODEC_FLAG_QPEL;
+    c->mb_decision  = s->mb_decision;
+    c->me_cmp       = s->fast_first_pass ? FF_CMP_SAD : avctx->me_cmp;
+    c->mb_cmp       = s->fast_first_pass ? FF_CMP_SAD : avctx->mb_cmp;
+    c->me_sub_cmp   = s->fast_first_pass ? FF_CMP_SAD : avctx->me_sub_cmp;
+    c->pix_fmt      = AV_PIX_FMT_YUV420P;
+    c->time_base    = avctx->time_base;
+    c->max_b_frames = s->max_b_frames;
+
+    ret = avcodec_open2(c, avctx->codec, NULL);
+    if (ret < 0)
+        avcodec_free_context(&s->b_count_ctx[idx]);
+    return ret;
+}
+
+/**
+ * Trial encode of the downscaled lookahead window with a fixed B-frame
+ * count. Every candidate has its own encoder context and only reads
+ * s->tmp_frames, so candidates can run concurrently. The window is
+ * flushed at the end, leaving the context ready for the next decision.
+ */
+static int estimate_b_count_worker(AVCodecContext *avctx, void *arg)
+{
+    MpegEncContext *s = avctx->priv_data;
+    BCountEstimate *e = arg;
+    AVCodecContext *c = e->c;
+    AVFrame *frame    = av_frame_alloc();
+    int64_t rd = 0;
+    int i, ret, out_size;
+
+    if (!frame)
+        return AVERROR(ENOMEM);
+
+    c->error[0] = c->error[1] = c->error[2] = 0;
+    reset_b_count_context(c);
+
+    /* the frame properties differ between candidates, so each one works
+     * on its own reference to the shared downscaled data */
+    ret = av_frame_ref(frame, s->tmp_frames[0]);
+    if (ret < 0)
+        goto fail;
+    frame->pict_type = AV_PICTURE_TYPE_I;
+    frame->quality   = 1 * FF_QP2LAMBDA;
+
+    out_size = encode_frame(c, frame);
+    av_frame_unref(frame);
+
+    //rd += (out_size * e->lambda2) >> FF_LAMBDA_SHIFT;
+
+    for (i = 0; i < s->max_b_frames + 1; i++) {
+        int is_p = i % (e->b_count + 1) == e->b_count || i == s->max_b_frames;
+
+        ret = av_frame_ref(frame, s->tmp_frames[i + 1]);
+        if (ret < 0)
+            goto fail;
+        frame->pict_type = is_p ? AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_B;
+        frame->quality   = is_p ? e->p_lambda : e->b_lambda;
+
+        out_size = encode_frame(c, frame);
+        av_frame_unref(frame);
+
+        rd += (out_size * e->lambda2) >> (FF_LAMBDA_SHIFT - 3);
+    }
+
+    /* get the delayed frames */
+    while (out_size) {
+        out_size = encode_frame(c, NULL);
+        rd += (out_size * e->lambda2) >> (FF_LAMBDA_SHIFT - 3);
+    }
+
+    rd += c->error[0] + c->error[1] + c->error[2];
+
+    e->rd = rd;
+    ret   = 0;
+fail:
+    av_frame_free(&frame);
+    return ret;
+}
+
 static int estimate_best_b_count(MpegEncContext *s)
 {
-    AVCodec *codec    = avcodec_find_encoder(s->avctx->codec_id);
-    AVCodecContext *c = avcodec_alloc_context3(NULL);
+    BCountEstimate est[MAX_B_FRAMES + 1] = { { 0 } };
+    int ret[MAX_B_FRAMES + 1];
     const int scale = s->brd_scale;
-    int i, j, out_size, p_lambda, b_lambda, lambda2;
+    int i, j, k, p_lambda, b_lambda, lambda2, nb_est, err;
     int64_t best_rd  = INT64_MAX;
     int best_b_count = -1;
 
-    if (!c)
-        return AVERROR(ENOMEM);
     av_assert0(scale >= 0 && scale <= 3);
 
     //emms_c();
@@ -1430,97 +1685,87 @@ static int estimate_best_b_count(MpegEncContext *s)
     lambda2  = (b_lambda * b_lambda + (1 << FF_LAMBDA_SHIFT) / 2) >>
                FF_LAMBDA_SHIFT;
 
-    c->width        = s->width  >> scale;
-    c->height       = s->height >> scale;
-    c->flags        = AV_CODEC_FLAG_QSCALE | AV_CODEC_FLAG_PSNR;
-    c->flags       |= s->avctx->flags & AV_CODEC_FLAG_QPEL;
-    c->mb_decision  = s->avctx->mb_decision;
-    c->me_cmp       = s->avctx->me_cmp;
-    c->mb_cmp       = s->avctx->mb_cmp;
-    c->me_sub_cmp   = s->avctx->me_sub_cmp;
-    c->pix_fmt      = AV_PIX_FMT_YUV420P;
-    c->time_base    = s->avctx->time_base;
-    c->max_b_frames = s->max_b_frames;
-
-    if (avcodec_open2(c, codec, NULL) < 0)
-        return -1;
-
     for (i = 0; i < s->max_b_frames + 2; i++) {
         Picture pre_input, *pre_input_ptr = i ? s->input_picture[i - 1] :
                                                 s->next_picture_ptr;
         uint8_t *data[4];
-
-        if (pre_input_ptr && (!i || s->input_picture[i - 1])) {
-            pre_input = *pre_input_ptr;
-            memcpy(data, pre_input_ptr->f->data, sizeof(data));
-
-            if (!pre_input.shared && i) {
-                data[0] += INPLACE_OFFSET;
-                data[1] += INPLACE_OFFSET;
-                data[2] += INPLACE_OFFSET;
+        int pic_num;
+
+        if (!pre_input_ptr || (i && !s->input_picture[i - 1]))
+            continue;
+
+        /* The input pictures of one window mostly reappear in the next
+         * one, only shifted by the number of frames coded in between, so
+         * reuse their downscaled copies. Slot 0 holds the reconstructed
+         * reference and always has to be redone. */
+        pic_num = i ? pre_input_ptr->f->display_picture_number : -1;
+        if (i) {
+            for (k = i; k < s->max_b_frames + 2; k++)
+                if (s->tmp_frames_pic_num[k] == pic_num)
+                    break;
+            if (k < s->max_b_frames + 2) {
+                FFSWAP(AVFrame *, s->tmp_frames[i], s->tmp_frames[k]);
+                FFSWAP(int, s->tmp_frames_pic_num[i], s->tmp_frames_pic_num[k]);
+                continue;
             }
-
-            s->mpvencdsp.shrink[scale](s->tmp_frames[i]->data[0],
-                                       s->tmp_frames[i]->linesize[0],
-                                       data[0],
-                                       pre_input.f->linesize[0],
-                                       c->width, c->height);
-            s->mpvencdsp.shrink[scale](s->tmp_frames[i]->data[1],
-                                       s->tmp_frames[i]->linesize[1],
-                                       data[1],
-                                       pre_input.f->linesize[1],
-                                       c->width >> 1, c->height >> 1);
-            s->mpvencdsp.shrink[scale](s->tmp_frames[i]->data[2],
-                                       s->tmp_frames[i]->linesize[2],
-                                       data[2],
-                                       pre_input.f->linesize[2],
-                                       c->width >> 1, c->height >> 1);
         }
-    }
-
-    for (j = 0; j < s->max_b_frames + 1; j++) {
-        int64_t rd = 0;
-
-        if (!s->input_picture[j])
-            break;
-
-        c->error[0] = c->error[1] = c->error[2] = 0;
-
-        s->tmp_frames[0]->pict_type = AV_PICTURE_TYPE_I;
-        s->tmp_frames[0]->quality   = 1 * FF_QP2LAMBDA;
-
-        out_size = encode_frame(c, s->tmp_frames[0]);
 
-        //rd += (out_size * lambda2) >> FF_LAMBDA_SHIFT;
+        pre_input = *pre_input_ptr;
+        memcpy(data, pre_input_ptr->f->data, sizeof(data));
 
-        for (i = 0; i < s->max_b_frames + 1; i++) {
-            int is_p = i % (j + 1) == j || i == s->max_b_frames;
-
-            s->tmp_frames[i + 1]->pict_type = is_p ?
-                                     AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_B;
-            s->tmp_frames[i + 1]->quality   = is_p ? p_lambda : b_lambda;
+        if (!pre_input.shared && i) {
+            data[0] += INPLACE_OFFSET;
+            data[1] += INPLACE_OFFSET;
+            data[2] += INPLACE_OFFSET;
+        }
 
-            out_size = encode_frame(c, s->tmp_frames[i + 1]);
+        s->mpvencdsp.shrink[scale](s->tmp_frames[i]->data[0],
+                                   s->tmp_frames[i]->linesize[0],
+                                   data[0],
+                                   pre_input.f->linesize[0],
+                                   s->width >> scale, s->height >> scale);
+        s->mpvencdsp.shrink[scale](s->tmp_frames[i]->data[1],
+                                   s->tmp_frames[i]->linesize[1],
+                                   data[1],
+                                   pre_input.f->linesize[1],
+                                   s->width >> (scale + 1), s->height >> (scale + 1));
+        s->mpvencdsp.shrink[scale](s->tmp_frames[i]->data[2],
+                                   s->tmp_frames[i]->linesize[2],
+                                   data[2],
+                                   pre_input.f->linesize[2],
+                                   s->width >> (scale + 1), s->height >> (scale + 1));
+        s->tmp_frames_pic_num[i] = pic_num;
+    }
+
+    for (nb_est = 0; nb_est < s->max_b_frames + 1; nb_est++) {
+        BCountEstimate *e = &est[nb_est];
+
+        if (!s->input_picture[nb_est])
+            break;
 
-            rd += (out_size * lambda2) >> (FF_LAMBDA_SHIFT - 3);
-        }
+        if ((err = open_b_count_context(s, nb_est)) < 0)
+            return err;
 
-        /* get the delayed frames */
-        while (out_size) {
-            out_size = encode_frame(c, NULL);
-            rd += (out_size * lambda2) >> (FF_LAMBDA_SHIFT - 3);
-        }
+        e->c        = s->b_count_ctx[nb_est];
+        e->b_count  = nb_est;
+        e->p_lambda = p_lambda;
+        e->b_lambda = b_lambda;
+        e->lambda2  = lambda2;
+    }
 
-        rd += c->error[0] + c->error[1] + c->error[2];
+    /* the candidates are independent, spread them over the slice threads */
+    s->avctx->execute(s->avctx, estimate_b_count_worker, est, ret,
+                      nb_est, sizeof(*est));
 
-        if (rd < best_rd) {
-            best_rd = rd;
+    for (j = 0; j < nb_est; j++) {
+        if (ret[j] < 0)
+            return ret[j];
+        if (est[j].rd < best_rd) {
+            best_rd = est[j].rd;
             best_b_count = j;
         }
     }
 
-    avcodec_free_context(&c);
-
     return best_b_count;
 }
 
@@ -1921,7 +2166,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         if (avctx->rc_buffer_size) {
             RateControlContext *rcc = &s->rc_context;
             int max_size = FFMAX(rcc->buffer_index * avctx->rc_max_available_vbv_use, rcc->buffer_index - 500);
-            int hq = (s->avctx->mb_decision == FF_MB_DECISION_RD || s->avctx->trellis);
+            int hq = (s->mb_decision == FF_MB_DECISION_RD || s->trellis);
             int min_step = hq ? 1 : (1<<(FF_LAMBDA_SHIFT + 7))/139;
 
             if (put_bits_count(&s->pb) > max_size &&
@@ -2186,7 +2431,7 @@ static inline void clip_coeffs(MpegEncContext *s, int16_t *block,
         block[j] = level;
     }
 
-    if (overflow && s->avctx->mb_decision == FF_MB_DECISION_SIMPLE)
+    if (overflow && s->mb_decision == FF_MB_DECISION_SIMPLE)
         av_log(s->avctx, AV_LOG_INFO,
                "warning, clipping %d dct coefficients to %d..%d\n",
                overflow, minlevel, maxlevel);
@@ -2702,7 +2947,7 @@ static inline void encode_mb_hq(MpegEncContext *s, MpegEncContext *backup, MpegE
         score+= put_bits_count(&s->tex_pb);
     }
 
-    if(s->avctx->mb_decision == FF_MB_DECISION_RD){
+    if(s->mb_decision == FF_MB_DECISION_RD){
         ff_mpv_decode_mb(s, s->block);
 
         score *= s->lambda2;
@@ -2789,7 +3034,7 @@ static int estimate_motion_thread(AVCodecContext *c, void *arg){
 
     ff_check_alignment();
 
-    s->me.dia_size= s->avctx->dia_size;
+    s->me.dia_size= s->fast_first_pass ? FFMIN(s->avctx->dia_size, 1) : s->avctx->dia_size;
     s->first_slice_line=1;
     for(s->mb_y= s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
         s->mb_x=0; //for block init below
@@ -2836,6 +3081,209 @@ static int mb_var_thread(AVCodecContext *c, void *arg){
     return 0;
 }
 
+#if HAVE_THREADS
+/**
+ * Motion estimation with macroblock rows as jobs instead of whole slices.
+ * The slice threads pull the rows in order from the shared job counter, so
+ * the work is balanced whatever the content of the slices. The rows of a
+ * slice form a wavefront: a macroblock is estimated once the row above has
+ * finished its top right neighbour, the same predictors are thus available
+ * as when a slice is processed on its own and the output is unchanged.
+ * The slices of the bitstream are not affected, they are still coded by
+ * their own contexts in encode_thread().
+ *
+ * The B-frame search starts with the penalty factors left over from the
+ * previous macroblock of its context, those are carried along the rows of
+ * each slice the way a single context would see them.
+ */
+typedef struct MERowContext {
+    pthread_mutex_t mutex;
+    pthread_cond_t *cond;       ///< signalled when the progress of a row changes
+    int *progress;              ///< number of finished macroblocks of each row
+    int *fresh;                 ///< penalty factors of the current picture reached in the row
+    int *slice_start;           ///< first row of the slice containing each row
+    int *slice_end;             ///< end of the slice containing each row
+    int *slice_index;           ///< context of the slice containing each row
+    int stale[MAX_THREADS][3];  ///< penalty factors of the slice contexts before the picture
+    int factors[3];             ///< penalty factors of the current picture
+} MERowContext;
+
+static void me_get_factors(const MotionEstContext *c, int *f)
+{
+    f[0] = c->penalty_factor;
+    f[1] = c->sub_penalty_factor;
+    f[2] = c->mb_penalty_factor;
+}
+
+static void me_set_factors(MotionEstContext *c, const int *f)
+{
+    c->penalty_factor     = f[0];
+    c->sub_penalty_factor = f[1];
+    c->mb_penalty_factor  = f[2];
+}
+
+static av_cold void me_rows_uninit(MpegEncContext *s)
+{
+    MERowContext *rows = s->me_rows;
+    int i;
+
+    if (!rows)
+        return;
+    for (i = 0; i < s->mb_height; i++)
+        pthread_cond_destroy(&rows->cond[i]);
+    pthread_mutex_destroy(&rows->mutex);
+    av_freep(&rows->cond);
+    av_freep(&rows->progress);
+    av_freep(&rows->fresh);
+    av_freep(&rows->slice_start);
+    av_freep(&rows->slice_end);
+    av_freep(&rows->slice_index);
+    av_freep(&s->me_rows);
+}
+
+static av_cold int me_rows_init(MpegEncContext *s)
+{
+    MERowContext *rows;
+    int i;
+
+    /* every worker needs a context of its own */
+    if (!(s->avctx->active_thread_type & FF_THREAD_SLICE) ||
+        s->avctx->thread_count <= 1 ||
+        s->avctx->thread_count > s->slice_context_count)
+        return 0;
+
+    rows = s->me_rows = av_mallocz(sizeof(*rows));
+    if (!rows)
+        return AVERROR(ENOMEM);
+    rows->cond        = av_malloc_array(s->mb_height, sizeof(*rows->cond));
+    rows->progress    = av_malloc_array(s->mb_height, sizeof(*rows->progress));
+    rows->fresh       = av_malloc_array(s->mb_height, sizeof(*rows->fresh));
+    rows->slice_start = av_malloc_array(s->mb_height, sizeof(*rows->slice_start));
+    rows->slice_end   = av_malloc_array(s->mb_height, sizeof(*rows->slice_end));
+    rows->slice_index = av_malloc_array(s->mb_height, sizeof(*rows->slice_index));
+    if (!rows->cond || !rows->progress || !rows->fresh || !rows->slice_start ||
+        !rows->slice_end || !rows->slice_index) {
+        av_freep(&rows->cond);
+        av_freep(&rows->progress);
+        av_freep(&rows->fresh);
+        av_freep(&rows->slice_start);
+        av_freep(&rows->slice_end);
+        av_freep(&rows->slice_index);
+        av_freep(&s->me_rows);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_init(&rows->mutex, NULL);
+    for (i = 0; i < s->mb_height; i++)
+        pthread_cond_init(&rows->cond[i], NULL);
+    return 0;
+}
+
+static void me_row_wait(MERowContext *rows, int mb_y, int count)
+{
+    pthread_mutex_lock(&rows->mutex);
+    while (rows->progress[mb_y] < count)
+        pthread_cond_wait(&rows->cond[mb_y], &rows->mutex);
+    pthread_mutex_unlock(&rows->mutex);
+}
+
+static int estimate_motion_row(AVCodecContext *c, void *arg, int mb_y, int threadnr)
+{
+    MpegEncContext *s    = arg;
+    MERowContext *rows   = s->me_rows;
+    MpegEncContext *t    = s->thread_context[threadnr];
+    int fresh = 0;
+
+    t->start_mb_y       = rows->slice_start[mb_y];
+    t->end_mb_y         = rows->slice_end[mb_y];
+    t->me.dia_size      = s->fast_first_pass ? FFMIN(c->dia_size, 1) : c->dia_size;
+    t->first_slice_line = mb_y == t->start_mb_y;
+    t->mb_y             = mb_y;
+
+    /* The factors are only unknown while the rows above in the slice
+     * consist of MPEG-4 direct macroblocks skipped early. */
+    if (!t->first_slice_line) {
+        pthread_mutex_lock(&rows->mutex);
+        while (!rows->fresh[mb_y - 1] && rows->progress[mb_y - 1] < t->mb_width)
+            pthread_cond_wait(&rows->cond[mb_y - 1], &rows->mutex);
+        fresh = rows->fresh[mb_y] = rows->fresh[mb_y - 1];
+        pthread_mutex_unlock(&rows->mutex);
+    }
+    me_set_factors(&t->me, fresh ? rows->factors : rows->stale[rows->slice_index[mb_y]]);
+
+    t->mb_x             = 0; //for block init below
+    ff_init_block_index(t);
+    for (t->mb_x = 0; t->mb_x < t->mb_width; t->mb_x++) {
+        const int xy = t->mb_y * t->mb_stride + t->mb_x;
+
+        t->block_index[0] += 2;
+        t->block_index[1] += 2;
+        t->block_index[2] += 2;
+        t->block_index[3] += 2;
+
+        if (!t->first_slice_line)
+            me_row_wait(rows, mb_y - 1, FFMIN(t->mb_x + 2, t->mb_width));
+
+        if (t->pict_type == AV_PICTURE_TYPE_B)
+            ff_estimate_b_frame_motion(t, t->mb_x, t->mb_y);
+        else
+            ff_estimate_p_frame_motion(t, t->mb_x, t->mb_y);
+
+        pthread_mutex_lock(&rows->mutex);
+        if (!fresh && (t->pict_type != AV_PICTURE_TYPE_B ||
+                       t->mb_type[xy] != CANDIDATE_MB_TYPE_DIRECT0)) {
+            me_get_factors(&t->me, rows->factors);
+            rows->fresh[mb_y] = fresh = 1;
+        }
+        rows->progress[mb_y] = t->mb_x + 1;
+        pthread_cond_broadcast(&rows->cond[mb_y]);
+        pthread_mutex_unlock(&rows->mutex);
+    }
+    return 0;
+}
+
+static int mb_var_row(AVCodecContext *c, void *arg, int mb_y, int threadnr)
+{
+    MpegEncContext *s = arg;
+    MpegEncContext *t = s->thread_context[threadnr];
+
+    t->start_mb_y = mb_y;
+    t->end_mb_y   = mb_y + 1;
+    return mb_var_thread(c, &t);
+}
+
+static void execute_rows(MpegEncContext *s, int context_count,
+                         int (*func)(AVCodecContext *c, void *arg, int mb_y, int threadnr))
+{
+    MERowContext *rows = s->me_rows;
+    int start[MAX_THREADS], end[MAX_THREADS];
+    int i, y;
+
+    for (i = 0; i < context_count; i++) {
+        start[i] = s->thread_context[i]->start_mb_y;
+        end[i]   = s->thread_context[i]->end_mb_y;
+        me_get_factors(&s->thread_context[i]->me, rows->stale[i]);
+        for (y = start[i]; y < end[i]; y++) {
+            rows->slice_start[y] = start[i];
+            rows->slice_end[y]   = end[i];
+            rows->slice_index[y] = i;
+            rows->progress[y]    = 0;
+            rows->fresh[y]       = 0;
+        }
+    }
+
+    s->avctx->execute2(s->avctx, func, s, NULL, s->mb_height);
+
+    for (i = 0; i < context_count; i++) {
+        MpegEncContext *t = s->thread_context[i];
+
+        t->start_mb_y = start[i];
+        t->end_mb_y   = end[i];
+        if (end[i] > start[i])
+            me_set_factors(&t->me, rows->fresh[end[i] - 1] ? rows->factors : rows->stale[i]);
+    }
+}
+#endif
+
 static void write_slice_end(MpegEncContext *s){
     if(CONFIG_MPEG4_ENCODER && s->codec_id==AV_CODEC_ID_MPEG4){
         if(s->partitioned_frame){
@@ -3407,7 +3855,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
                     s->hdsp.put_pixels_tab[1][0](s->dest[2], s->sc.rd_scratchpad + 16*s->linesize + 8, s->uvlinesize, 8);
                 }
 
-                if(s->avctx->mb_decision == FF_MB_DECISION_BITS)
+                if(s->mb_decision == FF_MB_DECISION_BITS)
                     ff_mpv_decode_mb(s, s->block);
             } else {
                 int motion_x = 0, motion_y = 0;
@@ -3725,15 +4173,19 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     }
 
     s->mb_intra=0; //for the rate distortion & bit compare functions
+    ff_me_pyramid_search(s);
+
+    /* before the slice contexts are updated, so that they all use the
+     * rounding of this picture */
+    if(ff_init_me(s)<0)
+        return -1;
+
     for(i=1; i<context_count; i++){
         ret = ff_update_duplicate_context(s->thread_context[i], s);
         if (ret < 0)
             return ret;
     }
 
-    if(ff_init_me(s)<0)
-        return -1;
-
     /* Estimate motion for every MB */
     if(s->pict_type != AV_PICTURE_TYPE_I){
         s->lambda  = (s->lambda  * s->me_penalty_compensation + 128) >> 8;
@@ -3745,6 +4197,11 @@ static int encode_picture(MpegEncContext *s, int picture_number)
             }
         }
 
+#if HAVE_THREADS
+        if (s->me_rows)
+            execute_rows(s, context_count, estimate_motion_row);
+        else
+#endif
         s->avctx->execute(s->avctx, estimate_motion_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
     }else /* if(s->pict_type == AV_PICTURE_TYPE_I) */{
         /* I-Frame */
@@ -3753,6 +4210,11 @@ static int encode_picture(MpegEncContext *s, int picture_number)
 
         if(!s->fixed_qscale){
             /* finding spatial complexity for I-frame rate control */
+#if HAVE_THREADS
+            if (s->me_rows)
+                execute_rows(s, context_count, mb_var_row);
+            else
+#endif
             s->avctx->execute(s->avctx, mb_var_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
         }
     }
@@ -3981,7 +4443,6 @@ static int dct_quantize_trellis_c(MpegEncContext *s,
     const uint8_t *scantable= s->intra_scantable.scantable;
     const uint8_t *perm_scantable= s->intra_scantable.permutated;
     int max=0;
-    unsigned int threshold1, threshold2;
     int bias=0;
     int run_tab[65];
     int level_tab[65];
@@ -3994,6 +4455,7 @@ static int dct_quantize_trellis_c(MpegEncContext *s,
     int last_i;
     int coeff[2][64];
     int coeff_count[64];
+    LOCAL_ALIGNED_32(int, qlevel, [64]);
     int qmul, qadd, start_i, last_non_zero, i, dc;
     const int esc_length= s->ac_esc_length;
     uint8_t * length;
@@ -4051,14 +4513,11 @@ static int dct_quantize_trellis_c(MpegEncContext *s,
     }
     last_i= start_i;
 
-    threshold1= (1<<QMAT_SHIFT) - bias - 1;
-    threshold2= (threshold1<<1);
+    /* quantize the whole block at once, a level of 0 is below the threshold */
+    s->mpvencdsp.quantize_levels(qlevel, block, qmat, bias, QMAT_SHIFT);
 
     for(i=63; i>=start_i; i--) {
-        const int j = scantable[i];
-        int level = block[j] * qmat[j];
-
-        if(((unsigned)(level+threshold1))>threshold2){
+        if (qlevel[scantable[i]]) {
             last_non_zero = i;
             break;
         }
@@ -4066,27 +4525,21 @@ static int dct_quantize_trellis_c(MpegEncContext *s,
 
     for(i=start_i; i<=last_non_zero; i++) {
         const int j = scantable[i];
-        int level = block[j] * qmat[j];
+        int level = qlevel[j];
 
-//        if(   bias+level >= (1<<(QMAT_SHIFT - 3))
-//           || bias-level >= (1<<(QMAT_SHIFT - 3))){
-        if(((unsigned)(level+threshold1))>threshold2){
+        if (level) {
+            coeff[0][i]= level;
             if(level>0){
-                level= (bias + level)>>QMAT_SHIFT;
-                coeff[0][i]= level;
                 coeff[1][i]= level-1;
-//                coeff[2][k]= level-2;
             }else{
-                level= (bias - level)>>QMAT_SHIFT;
-                coeff[0][i]= -level;
+                level= -level;
                 coeff[1][i]= -level+1;
-//                coeff[2][k]= -level+2;
             }
             coeff_count[i]= FFMIN(level, 2);
             av_assert2(coeff_count[i]);
             max |=level;
         }else{
-            coeff[0][i]= (level>>31)|1;
+            coeff[0][i]= (block[j]>>15)|1;
             coeff_count[i]= 1;
         }
     }
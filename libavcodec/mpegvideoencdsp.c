@@ -240,6 +240,21 @@ static void shrink88(uint8_t *dst, int dst_wrap,
     }
 }
 
+static void quantize_levels_c(int *level, const int16_t *block,
+                              const int *qmat, int bias, int shift)
+{
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        int v = block[i] * qmat[i];
+
+        if (v > 0)
+            level[i] =   (bias + v) >> shift;
+        else
+            level[i] = -((bias - v) >> shift);
+    }
+}
+
 av_cold void ff_mpegvideoencdsp_init(MpegvideoEncDSPContext *c,
                                      AVCodecContext *avctx)
 {
@@ -256,6 +271,8 @@ av_cold void ff_mpegvideoencdsp_init(MpegvideoEncDSPContext *c,
 
     c->draw_edges = draw_edges_8_c;
 
+    c->quantize_levels = quantize_levels_c;
+
     if (ARCH_ARM)
         ff_mpegvideoencdsp_init_arm(c, avctx);
     if (ARCH_PPC)
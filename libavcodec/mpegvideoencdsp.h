@@ -42,6 +42,14 @@ typedef struct MpegvideoEncDSPContext {
 
     void (*draw_edges)(uint8_t *buf, int wrap, int width, int height,
                        int w, int h, int sides);
+
+    /**
+     * Quantize a whole block, used to build the trellis candidates.
+     * level[i] = sign(block[i]) * ((bias + |block[i] * qmat[i]|) >> shift)
+     * @param level output, 32-byte aligned
+     */
+    void (*quantize_levels)(int *level, const int16_t *block,
+                            const int *qmat, int bias, int shift);
 } MpegvideoEncDSPContext;
 
 void ff_mpegvideoencdsp_init(MpegvideoEncDSPContext *c,
@@ -135,6 +135,8 @@ typedef struct OpusStreamContext {
     int delayed_samples;
 
     OpusPacket packet;
+    /* start of this stream's sub-packet in the current input packet */
+    const uint8_t *packet_buf;
 
     int redundancy_idx;
 } OpusStreamContext;
@@ -31,15 +31,9 @@
 
 #include "imdct15.h"
 #include "opus.h"
+#include "opus_celt.h"
 #include "opustab.h"
 
-enum CeltSpread {
-    CELT_SPREAD_NONE,
-    CELT_SPREAD_LIGHT,
-    CELT_SPREAD_NORMAL,
-    CELT_SPREAD_AGGRESSIVE
-};
-
 typedef struct CeltFrame {
     float energy[CELT_MAX_BANDS];
     float prev_energy[2][CELT_MAX_BANDS];
@@ -103,25 +97,6 @@ struct CeltContext {
     DECLARE_ALIGNED(32, float, scratch)[22 * 8]; // MAX(ff_celt_freq_range) * 1<<CELT_MAX_LOG_BLOCKS
 };
 
-static inline int16_t celt_cos(int16_t x)
-{
-    x = (MUL16(x, x) + 4096) >> 13;
-    x = (32767-x) + ROUND_MUL16(x, (-7651 + ROUND_MUL16(x, (8277 + ROUND_MUL16(-626, x)))));
-    return 1+x;
-}
-
-static inline int celt_log2tan(int isin, int icos)
-{
-    int lc, ls;
-    lc = opus_ilog(icos);
-    ls = opus_ilog(isin);
-    icos <<= 15 - lc;
-    isin <<= 15 - ls;
-    return (ls << 11) - (lc << 11) +
-           ROUND_MUL16(isin, ROUND_MUL16(isin, -2597) + 7932) -
-           ROUND_MUL16(icos, ROUND_MUL16(icos, -2597) + 7932);
-}
-
 static inline uint32_t celt_rng(CeltContext *s)
 {
     s->seed = 1664525 * s->seed + 1013904223;
@@ -579,31 +554,6 @@ static void celt_decode_allocation(CeltContext *s, OpusRangeCoder *rc)
     }
 }
 
-static inline int celt_bits2pulses(const uint8_t *cache, int bits)
-{
-    // TODO: Find the size of cache and make it into an array in the parameters list
-    int i, low = 0, high;
-
-    high = cache[0];
-    bits--;
-
-    for (i = 0; i < 6; i++) {
-        int center = (low + high + 1) >> 1;
-        if (cache[center] >= bits)
-            high = center;
-        else
-            low = center;
-    }
-
-    return (bits - (low == 0 ? -1 : cache[low]) <= cache[high] - bits) ? low : high;
-}
-
-static inline int celt_pulses2bits(const uint8_t *cache, int pulses)
-{
-    // TODO: Find the size of cache and make it into an array in the parameters list
-   return (pulses == 0) ? 0 : cache[pulses] + 1;
-}
-
 static inline void celt_normalize_residual(const int * av_restrict iy, float * av_restrict X,
                                            int N, float g)
 {
@@ -612,67 +562,6 @@ static inline void celt_normalize_residual(const int * av_restrict iy, float * a
         X[i] = g * iy[i];
 }
 
-static void celt_exp_rotation1(float *X, unsigned int len, unsigned int stride,
-                               float c, float s)
-{
-    float *Xptr;
-    int i;
-
-    Xptr = X;
-    for (i = 0; i < len - stride; i++) {
-        float x1, x2;
-        x1           = Xptr[0];
-        x2           = Xptr[stride];
-        Xptr[stride] = c * x2 + s * x1;
-        *Xptr++      = c * x1 - s * x2;
-    }
-
-    Xptr = &X[len - 2 * stride - 1];
-    for (i = len - 2 * stride - 1; i >= 0; i--) {
-        float x1, x2;
-        x1           = Xptr[0];
-        x2           = Xptr[stride];
-        Xptr[stride] = c * x2 + s * x1;
-        *Xptr--      = c * x1 - s * x2;
-    }
-}
-
-static inline void celt_exp_rotation(float *X, unsigned int len,
-                                     unsigned int stride, unsigned int K,
-                                     enum CeltSpread spread)
-{
-    unsigned int stride2 = 0;
-    float c, s;
-    float gain, theta;
-    int i;
-
-    if (2*K >= len || spread == CELT_SPREAD_NONE)
-        return;
-
-    gain = (float)len / (len + (20 - 5*spread) * K);
-    theta = M_PI * gain * gain / 4;
-
-    c = cos(theta);
-    s = sin(theta);
-
-    if (len >= stride << 3) {
-        stride2 = 1;
-        /* This is just a simple (equivalent) way of computing sqrt(len/stride) with rounding.
-        It's basically incrementing long as (stride2+0.5)^2 < len/stride. */
-        while ((stride2 * stride2 + stride2) * stride + (stride >> 2) < len)
-            stride2++;
-    }
-
-    /*NOTE: As a minor optimization, we could be passing around log2(B), not B, for both this and for
-    extract_collapse_mask().*/
-    len /= stride;
-    for (i = 0; i < stride; i++) {
-        if (stride2)
-            celt_exp_rotation1(X + i * len, len, stride2, s, c);
-        celt_exp_rotation1(X + i * len, len, 1, c, s);
-    }
-}
-
 static inline unsigned int celt_extract_collapse_mask(const int *iy,
                                                       unsigned int N,
                                                       unsigned int B)
@@ -802,23 +691,6 @@ static void celt_haar1(float *X, int N0, int stride)
     }
 }
 
-static inline int celt_compute_qn(int N, int b, int offset, int pulse_cap,
-                                  int dualstereo)
-{
-    int qn, qb;
-    int N2 = 2 * N - 1;
-    if (dualstereo && N == 2)
-        N2--;
-
-    /* The upper limit ensures that in a stereo split with itheta==16384, we'll
-     * always have enough bits left over to code at least one pulse in the
-     * side; otherwise it would collapse, since it doesn't get folded. */
-    qb = FFMIN3(b - pulse_cap - (4 << 3), (b + N2 * offset) / N2, 8 << 3);
-    qn = (qb < (1 << 3 >> 1)) ? 1 : ((ff_celt_qn_exp2[qb & 0x7] >> (14 - (qb >> 3))) + 1) >> 1 << 1;
-    return qn;
-}
-
-// this code was adapted from libopus
 static inline uint64_t celt_cwrsi(unsigned int N, unsigned int K, unsigned int i, int *y)
 {
     uint64_t norm = 0;
@@ -907,8 +779,6 @@ static inline uint64_t celt_cwrsi(unsigned int N, unsigned int K, unsigned int i
 static inline float celt_decode_pulses(OpusRangeCoder *rc, int *y, unsigned int N, unsigned int K)
 {
     unsigned int idx;
-#define CELT_PVQ_U(n, k) (ff_celt_pvq_u_row[FFMIN(n, k)][FFMAX(n, k)])
-#define CELT_PVQ_V(n, k) (CELT_PVQ_U(n, k) + CELT_PVQ_U(n, (k) + 1))
     idx = ff_opus_rc_dec_uint(rc, CELT_PVQ_V(N, K));
     return celt_cwrsi(N, K, idx, y);
 }
@@ -924,7 +794,7 @@ static inline unsigned int celt_alg_unquant(OpusRangeCoder *rc, float *X,
 
     gain /= sqrtf(celt_decode_pulses(rc, y, N, K));
     celt_normalize_residual(y, X, N, gain);
-    celt_exp_rotation(X, N, blocks, K, spread);
+    celt_exp_rotation(X, N, blocks, K, spread, -1);
     return celt_extract_collapse_mask(y, N, blocks);
 }
 
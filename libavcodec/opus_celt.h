@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2012 Andrew D'Addesio
+ * Copyright (c) 2013-2014 Mozilla Corporation
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * CELT helpers shared by the Opus decoder and encoder
+ */
+
+#ifndef AVCODEC_OPUS_CELT_H
+#define AVCODEC_OPUS_CELT_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "libavutil/common.h"
+
+#include "opus.h"
+#include "opus_rc.h"
+#include "opustab.h"
+
+enum CeltSpread {
+    CELT_SPREAD_NONE,
+    CELT_SPREAD_LIGHT,
+    CELT_SPREAD_NORMAL,
+    CELT_SPREAD_AGGRESSIVE
+};
+
+#define CELT_PVQ_U(n, k) (ff_celt_pvq_u_row[FFMIN(n, k)][FFMAX(n, k)])
+#define CELT_PVQ_V(n, k) (CELT_PVQ_U(n, k) + CELT_PVQ_U(n, (k) + 1))
+
+static inline int16_t celt_cos(int16_t x)
+{
+    x = (MUL16(x, x) + 4096) >> 13;
+    x = (32767-x) + ROUND_MUL16(x, (-7651 + ROUND_MUL16(x, (8277 + ROUND_MUL16(-626, x)))));
+    return 1+x;
+}
+
+static inline int celt_log2tan(int isin, int icos)
+{
+    int lc, ls;
+    lc = opus_ilog(icos);
+    ls = opus_ilog(isin);
+    icos <<= 15 - lc;
+    isin <<= 15 - ls;
+    return (ls << 11) - (lc << 11) +
+           ROUND_MUL16(isin, ROUND_MUL16(isin, -2597) + 7932) -
+           ROUND_MUL16(icos, ROUND_MUL16(icos, -2597) + 7932);
+}
+
+static inline int celt_bits2pulses(const uint8_t *cache, int bits)
+{
+    // TODO: Find the size of cache and make it into an array in the parameters list
+    int i, low = 0, high;
+
+    high = cache[0];
+    bits--;
+
+    for (i = 0; i < 6; i++) {
+        int center = (low + high + 1) >> 1;
+        if (cache[center] >= bits)
+            high = center;
+        else
+            low = center;
+    }
+
+    return (bits - (low == 0 ? -1 : cache[low]) <= cache[high] - bits) ? low : high;
+}
+
+static inline int celt_pulses2bits(const uint8_t *cache, int pulses)
+{
+    // TODO: Find the size of cache and make it into an array in the parameters list
+   return (pulses == 0) ? 0 : cache[pulses] + 1;
+}
+
+static inline void celt_exp_rotation1(float *X, unsigned int len, unsigned int stride,
+                               float c, float s)
+{
+    float *Xptr;
+    int i;
+
+    Xptr = X;
+    for (i = 0; i < len - stride; i++) {
+        float x1, x2;
+        x1           = Xptr[0];
+        x2           = Xptr[stride];
+        Xptr[stride] = c * x2 + s * x1;
+        *Xptr++      = c * x1 - s * x2;
+    }
+
+    Xptr = &X[len - 2 * stride - 1];
+    for (i = len - 2 * stride - 1; i >= 0; i--) {
+        float x1, x2;
+        x1           = Xptr[0];
+        x2           = Xptr[stride];
+        Xptr[stride] = c * x2 + s * x1;
+        *Xptr--      = c * x1 - s * x2;
+    }
+}
+
+/**
+ * Apply the spreading rotation, dir < 0 undoes it (decoder), dir > 0 applies
+ * it to a vector before PVQ search (encoder).
+ */
+static inline void celt_exp_rotation(float *X, unsigned int len,
+                                     unsigned int stride, unsigned int K,
+                                     enum CeltSpread spread, int dir)
+{
+    unsigned int stride2 = 0;
+    float c, s;
+    float gain, theta;
+    int i;
+
+    if (2*K >= len || spread == CELT_SPREAD_NONE)
+        return;
+
+    gain = (float)len / (len + (20 - 5*spread) * K);
+    theta = M_PI * gain * gain / 4;
+
+    c = cos(theta);
+    s = sin(theta);
+
+    if (len >= stride << 3) {
+        stride2 = 1;
+        /* This is just a simple (equivalent) way of computing sqrt(len/stride) with rounding.
+        It's basically incrementing long as (stride2+0.5)^2 < len/stride. */
+        while ((stride2 * stride2 + stride2) * stride + (stride >> 2) < len)
+            stride2++;
+    }
+
+    /*NOTE: As a minor optimization, we could be passing around log2(B), not B, for both this and for
+    extract_collapse_mask().*/
+    len /= stride;
+    for (i = 0; i < stride; i++) {
+        if (dir < 0) {
+            if (stride2)
+                celt_exp_rotation1(X + i * len, len, stride2, s, c);
+            celt_exp_rotation1(X + i * len, len, 1, c, s);
+        } else {
+            celt_exp_rotation1(X + i * len, len, 1, c, -s);
+            if (stride2)
+                celt_exp_rotation1(X + i * len, len, stride2, s, -c);
+        }
+    }
+}
+
+static inline int celt_compute_qn(int N, int b, int offset, int pulse_cap,
+                                  int dualstereo)
+{
+    int qn, qb;
+    int N2 = 2 * N - 1;
+    if (dualstereo && N == 2)
+        N2--;
+
+    /* The upper limit ensures that in a stereo split with itheta==16384, we'll
+     * always have enough bits left over to code at least one pulse in the
+     * side; otherwise it would collapse, since it doesn't get folded. */
+    qb = FFMIN3(b - pulse_cap - (4 << 3), (b + N2 * offset) / N2, 8 << 3);
+    qn = (qb < (1 << 3 >> 1)) ? 1 : ((ff_celt_qn_exp2[qb & 0x7] >> (14 - (qb >> 3))) + 1) >> 1 << 1;
+    return qn;
+}
+
+
+#endif /* AVCODEC_OPUS_CELT_H */
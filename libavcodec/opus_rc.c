@@ -20,6 +20,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
+
+#include "libavutil/error.h"
+
 #include "opus_rc.h"
 
 static av_always_inline void opus_rc_dec_normalize(OpusRangeCoder *rc)
@@ -219,3 +223,242 @@ void ff_opus_rc_dec_raw_init(OpusRangeCoder *rc, const uint8_t *rightend, uint32
     rc->rb.cachelen = 0;
     rc->rb.cacheval = 0;
 }
+
+#define OPUS_RC_BITS  32
+#define OPUS_RC_SYM   8
+#define OPUS_RC_SHIFT (OPUS_RC_BITS - OPUS_RC_SYM - 1)
+#define OPUS_RC_TOP   (1u << 31)
+#define OPUS_RC_BOT   (OPUS_RC_TOP >> OPUS_RC_SYM)
+
+static av_always_inline void opus_rc_enc_write_byte(OpusRangeCoder *rc, int val)
+{
+    if (rc->offs + rc->end_offs >= rc->buf_size) {
+        rc->error = 1;
+        return;
+    }
+    rc->buf[rc->offs++] = val;
+}
+
+static av_always_inline void opus_rc_enc_write_byte_at_end(OpusRangeCoder *rc, int val)
+{
+    if (rc->offs + rc->end_offs >= rc->buf_size) {
+        rc->error = 1;
+        return;
+    }
+    rc->buf[rc->buf_size - ++rc->end_offs] = val;
+}
+
+/* Delay the output of a byte until it is known whether a carry propagates
+ * into it; runs of 0xFF are counted and resolved together. */
+static av_always_inline void opus_rc_enc_carry_out(OpusRangeCoder *rc, int cbuf)
+{
+    if (cbuf != 0xFF) {
+        int carry = cbuf >> OPUS_RC_SYM;
+        if (rc->rem >= 0)
+            opus_rc_enc_write_byte(rc, rc->rem + carry);
+        if (rc->ext > 0) {
+            int sym = (0xFF + carry) & 0xFF;
+            do opus_rc_enc_write_byte(rc, sym);
+            while (--rc->ext > 0);
+        }
+        rc->rem = cbuf & 0xFF;
+    } else {
+        rc->ext++;
+    }
+}
+
+static av_always_inline void opus_rc_enc_normalize(OpusRangeCoder *rc)
+{
+    while (rc->range <= OPUS_RC_BOT) {
+        opus_rc_enc_carry_out(rc, rc->value >> OPUS_RC_SHIFT);
+        rc->value            = (rc->value << OPUS_RC_SYM) & (OPUS_RC_TOP - 1);
+        rc->range          <<= OPUS_RC_SYM;
+        rc->total_read_bits += OPUS_RC_SYM;
+    }
+}
+
+static av_always_inline void opus_rc_enc_update(OpusRangeCoder *rc, uint32_t low,
+                                                uint32_t high, uint32_t total)
+{
+    uint32_t scale = rc->range / total;
+    if (low) {
+        rc->value += rc->range - scale * (total - low);
+        rc->range  = scale * (high - low);
+    } else {
+        rc->range -= scale * (total - high);
+    }
+    opus_rc_enc_normalize(rc);
+}
+
+void ff_opus_rc_enc_cdf(OpusRangeCoder *rc, int val, const uint16_t *cdf)
+{
+    opus_rc_enc_update(rc, val ? cdf[val] : 0, cdf[val + 1], cdf[0]);
+}
+
+void ff_opus_rc_enc_log(OpusRangeCoder *rc, int val, uint32_t bits)
+{
+    uint32_t scale = rc->range >> bits;
+    uint32_t rest  = rc->range - scale;
+
+    if (val)
+        rc->value += rest;
+    rc->range = val ? scale : rest;
+    opus_rc_enc_normalize(rc);
+}
+
+/**
+ * CELT: write 1-25 raw bits at the end of the frame, backwards byte-wise
+ */
+void ff_opus_rc_put_raw(OpusRangeCoder *rc, uint32_t val, uint32_t count)
+{
+    if (rc->end_bits + count > 32) {
+        do {
+            opus_rc_enc_write_byte_at_end(rc, rc->end_window & 0xFF);
+            rc->end_window >>= 8;
+            rc->end_bits    -= 8;
+        } while (rc->end_bits >= 8);
+    }
+    rc->end_window      |= av_mod_uintp2(val, count) << rc->end_bits;
+    rc->end_bits        += count;
+    rc->total_read_bits += count;
+}
+
+/**
+ * CELT: write a uniformly distributed integer
+ */
+void ff_opus_rc_enc_uint(OpusRangeCoder *rc, uint32_t val, uint32_t size)
+{
+    int bits = opus_ilog(size - 1);
+
+    if (bits > 8) {
+        uint32_t total = ((size - 1) >> (bits - 8)) + 1;
+        uint32_t k     = val >> (bits - 8);
+        opus_rc_enc_update(rc, k, k + 1, total);
+        ff_opus_rc_put_raw(rc, val, bits - 8);
+    } else {
+        opus_rc_enc_update(rc, val, val + 1, size);
+    }
+}
+
+void ff_opus_rc_enc_uint_step(OpusRangeCoder *rc, uint32_t val, int k0)
+{
+    /* Use a probability of 3 up to itheta=8192 and then use 1 after */
+    const uint32_t total = (k0 + 1)*3 + k0;
+    const uint32_t low   = (val <= k0) ? 3*(val + 0) : (val - 1 - k0) + 3*(k0 + 1);
+    const uint32_t high  = (val <= k0) ? 3*(val + 1) : (val - 0 - k0) + 3*(k0 + 1);
+
+    opus_rc_enc_update(rc, low, high, total);
+}
+
+void ff_opus_rc_enc_uint_tri(OpusRangeCoder *rc, uint32_t val, int qn)
+{
+    uint32_t symbol, low, total;
+
+    total = ((qn >> 1) + 1) * ((qn >> 1) + 1);
+
+    if (val <= qn >> 1) {
+        low    = val * (val + 1) >> 1;
+        symbol = val + 1;
+    } else {
+        low    = total - ((qn + 1 - val) * (qn + 2 - val) >> 1);
+        symbol = qn + 1 - val;
+    }
+
+    opus_rc_enc_update(rc, low, low + symbol, total);
+}
+
+void ff_opus_rc_enc_laplace(OpusRangeCoder *rc, int *value, uint32_t symbol, int decay)
+{
+    uint32_t low = 0;
+    int val = *value;
+
+    if (val) {
+        int i, s = -(val < 0);
+        val    = (val + s) ^ s;
+        low    = symbol;
+        symbol = ((32768 - 32 - symbol) * (16384 - decay)) >> 15;
+
+        /* search the decaying part of the distribution */
+        for (i = 1; symbol > 0 && i < val; i++) {
+            symbol *= 2;
+            low    += symbol + 2;
+            symbol  = (symbol * decay) >> 15;
+        }
+
+        /* everything beyond that has probability 1/32768 */
+        if (!symbol) {
+            int max_distance = (32768 - low - s) >> 1;
+            int distance     = FFMIN(val - i, max_distance - 1);
+            low   += 2 * distance + 1 + s;
+            symbol = FFMIN(1, 32768 - low);
+            *value = (i + distance + s) ^ s;
+        } else {
+            symbol += 1;
+            low    += symbol & ~s;
+        }
+    }
+
+    opus_rc_enc_update(rc, low, low + symbol, 32768);
+}
+
+void ff_opus_rc_enc_init(OpusRangeCoder *rc, uint8_t *buf, int size)
+{
+    rc->buf             = buf;
+    rc->buf_size        = size;
+    rc->offs            = 0;
+    rc->end_offs        = 0;
+    rc->end_window      = 0;
+    rc->end_bits        = 0;
+    rc->rem             = -1;
+    rc->ext             = 0;
+    rc->error           = 0;
+    rc->range           = OPUS_RC_TOP;
+    rc->value           = 0;
+    rc->total_read_bits = OPUS_RC_BITS + 1;
+}
+
+int ff_opus_rc_enc_end(OpusRangeCoder *rc)
+{
+    int bits = OPUS_RC_BITS - opus_ilog(rc->range);
+    uint32_t mask = (OPUS_RC_TOP - 1) >> bits;
+    uint32_t end  = (rc->value + mask) & ~mask;
+
+    /* output the minimum number of bits that ensures the symbols encoded
+     * thus far will be decoded correctly regardless of the bits that follow */
+    if ((end | mask) >= rc->value + rc->range) {
+        bits++;
+        mask >>= 1;
+        end = (rc->value + mask) & ~mask;
+    }
+    while (bits > 0) {
+        opus_rc_enc_carry_out(rc, end >> OPUS_RC_SHIFT);
+        end   = (end << OPUS_RC_SYM) & (OPUS_RC_TOP - 1);
+        bits -= OPUS_RC_SYM;
+    }
+    if (rc->rem >= 0 || rc->ext > 0)
+        opus_rc_enc_carry_out(rc, 0);
+
+    /* flush the raw bits */
+    while (rc->end_bits >= 8) {
+        opus_rc_enc_write_byte_at_end(rc, rc->end_window & 0xFF);
+        rc->end_window >>= 8;
+        rc->end_bits    -= 8;
+    }
+
+    if (!rc->error) {
+        memset(rc->buf + rc->offs, 0, rc->buf_size - rc->offs - rc->end_offs);
+        if (rc->end_bits > 0) {
+            if (rc->end_offs >= rc->buf_size) {
+                rc->error = 1;
+            } else {
+                bits = -bits;
+                if (rc->offs + rc->end_offs >= rc->buf_size && bits < rc->end_bits)
+                    rc->error = 1;
+                else
+                    rc->buf[rc->buf_size - rc->end_offs - 1] |= rc->end_window;
+            }
+        }
+    }
+
+    return rc->error ? AVERROR(ENOSPC) : 0;
+}
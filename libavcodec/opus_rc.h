@@ -41,6 +41,18 @@ typedef struct OpusRangeCoder {
     uint32_t range;
     uint32_t value;
     uint32_t total_read_bits;
+
+    /* encoder only, value holds the low end of the coded interval and
+     * total_read_bits the number of bits written so far */
+    uint8_t *buf;
+    uint32_t buf_size;
+    uint32_t offs;          ///< range coded bytes written from the start
+    uint32_t end_offs;      ///< raw bytes written from the end
+    uint32_t end_window;
+    int      end_bits;
+    int      rem;           ///< buffered byte waiting for a possible carry
+    int      ext;           ///< number of buffered 0xFF bytes
+    int      error;
 } OpusRangeCoder;
 
 /**
@@ -82,4 +94,19 @@ int      ff_opus_rc_dec_laplace(OpusRangeCoder *rc, uint32_t symbol, int decay);
 int  ff_opus_rc_dec_init(OpusRangeCoder *rc, const uint8_t *data, int size);
 void ff_opus_rc_dec_raw_init(OpusRangeCoder *rc, const uint8_t *rightend, uint32_t bytes);
 
+void ff_opus_rc_enc_cdf(OpusRangeCoder *rc, int val, const uint16_t *cdf);
+void ff_opus_rc_enc_log(OpusRangeCoder *rc, int val, uint32_t bits);
+void ff_opus_rc_enc_uint(OpusRangeCoder *rc, uint32_t val, uint32_t size);
+void ff_opus_rc_enc_uint_step(OpusRangeCoder *rc, uint32_t val, int k0);
+void ff_opus_rc_enc_uint_tri(OpusRangeCoder *rc, uint32_t val, int qn);
+void ff_opus_rc_put_raw(OpusRangeCoder *rc, uint32_t val, uint32_t count);
+void ff_opus_rc_enc_laplace(OpusRangeCoder *rc, int *value, uint32_t symbol, int decay);
+
+void ff_opus_rc_enc_init(OpusRangeCoder *rc, uint8_t *buf, int size);
+/**
+ * Flush the range coder and merge the raw bits written at the end of the
+ * buffer, returns a negative value if the buffer was too small.
+ */
+int  ff_opus_rc_enc_end(OpusRangeCoder *rc);
+
 #endif /* AVCODEC_OPUS_RC_H */
@@ -419,6 +419,17 @@ finish:
     return output_samples;
 }
 
+static int opus_decode_substream(AVCodecContext *avctx, void *arg,
+                                 int jobnr, int threadnr)
+{
+    OpusContext       *c = avctx->priv_data;
+    OpusStreamContext *s = &c->streams[jobnr];
+
+    return opus_decode_subpacket(s, s->packet_buf, s->packet.data_size,
+                                 c->out + 2 * jobnr, c->out_size[jobnr],
+                                 s->packet.frame_count * s->packet.frame_duration);
+}
+
 static int opus_decode_packet(AVCodecContext *avctx, void *data,
                               int *got_frame_ptr, AVPacket *avpkt)
 {
@@ -504,7 +515,7 @@ static int opus_decode_packet(AVCodecContext *avctx, void *data,
         c->out_size[i] = frame->linesize[0] - ret * sizeof(float);
     }
 
-    /* decode each sub-packet */
+    /* parse the header of each sub-packet */
     for (i = 0; i < c->nb_streams; i++) {
         OpusStreamContext *s = &c->streams[i];
 
@@ -523,15 +534,24 @@ static int opus_decode_packet(AVCodecContext *avctx, void *data,
             s->silk_samplerate = get_silk_samplerate(s->packet.config);
         }
 
-        ret = opus_decode_subpacket(&c->streams[i], buf, s->packet.data_size,
-                                    c->out + 2 * i, c->out_size[i], coded_samples);
-        if (ret < 0)
-            return ret;
-        c->decoded_samples[i] = ret;
-        decoded_samples       = FFMIN(decoded_samples, ret);
+        s->packet_buf = buf;
+        if (buf) {
+            buf      += s->packet.packet_size;
+            buf_size -= s->packet.packet_size;
+        }
+    }
 
-        buf      += s->packet.packet_size;
-        buf_size -= s->packet.packet_size;
+    /* the streams are independent, so decode them in parallel */
+    if (c->nb_streams > 1)
+        avctx->execute2(avctx, opus_decode_substream, NULL,
+                        c->decoded_samples, c->nb_streams);
+    else
+        c->decoded_samples[0] = opus_decode_substream(avctx, NULL, 0, 0);
+
+    for (i = 0; i < c->nb_streams; i++) {
+        if (c->decoded_samples[i] < 0)
+            return c->decoded_samples[i];
+        decoded_samples = FFMIN(decoded_samples, c->decoded_samples[i]);
     }
 
     /* buffer the extra samples */
@@ -730,5 +750,7 @@ AVCodec ff_opus_decoder = {
     .close           = opus_decode_close,
     .decode          = opus_decode_packet,
     .flush           = opus_decode_flush,
-    .capabilities    = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY,
+    /* slice threads are only used for multistream (channel mapping != 0)
+     * input, see ff_slice_thread_init() */
+    .capabilities    = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS,
 };
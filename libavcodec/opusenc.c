@@ -0,0 +1,1074 @@
+/*
+ * Opus encoder
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Opus CELT-only encoder
+ *
+ * Produces constant bitrate, fullband, 20ms CELT frames using long blocks
+ * only. The bitstream decisions the encoder does not make itself (postfilter,
+ * transients, tf resolution, dynamic allocation) are signalled as disabled,
+ * while every allocation computation mirrors the decoder in opus_celt.c.
+ */
+
+#include "libavutil/channel_layout.h"
+#include "libavutil/float_dsp.h"
+
+#include "audio_frame_queue.h"
+#include "avcodec.h"
+#include "bytestream.h"
+#include "imdct15.h"
+#include "internal.h"
+#include "opus.h"
+#include "opus_celt.h"
+#include "opus_rc.h"
+#include "opustab.h"
+
+#define OPUS_ENC_DURATION 3 /* log2 of the number of short blocks per frame */
+#define OPUS_ENC_TOC      (31 << 3) /* CELT-only, fullband, 20ms, code 0 */
+
+/* compression levels below this use the low complexity PVQ search */
+#define OPUS_ENC_FAST_COMPLEXITY 5
+
+typedef struct OpusEncContext {
+    AVCodecContext    *avctx;
+    AudioFrameQueue    afq;
+    AVFloatDSPContext *dsp;
+    IMDCT15Context    *imdct;
+    OpusRangeCoder     rc;
+
+    int channels;
+    int complexity;
+    int frame_bytes;
+    int framebits;
+    int intra;
+
+    /* per frame allocation, mirrors the decoder's state */
+    int codedbands;
+    int intensitystereo;
+    int dualstereo;
+    enum CeltSpread spread;
+    int remaining;
+    int remaining2;
+    int fine_bits    [CELT_MAX_BANDS];
+    int fine_priority[CELT_MAX_BANDS];
+    int pulses       [CELT_MAX_BANDS];
+
+    float preemph_mem[2];
+
+    /* band energies as reconstructed by the decoder */
+    float energy[2][CELT_MAX_BANDS];
+    /* target band energies and their quantization error */
+    float band_energy[2][CELT_MAX_BANDS];
+    float error[2][CELT_MAX_BANDS];
+    /* linear band amplitudes, used to weight an intensity downmix */
+    float band_amp[2][CELT_MAX_BANDS];
+
+    /* pre-emphasised input, CELT_OVERLAP samples of history + one frame */
+    DECLARE_ALIGNED(32, float, samples)[2][CELT_OVERLAP + CELT_MAX_FRAME_SIZE];
+    DECLARE_ALIGNED(32, float, coeffs)[2][CELT_MAX_FRAME_SIZE];
+    DECLARE_ALIGNED(32, float, fold)[CELT_MAX_FRAME_SIZE];
+    DECLARE_ALIGNED(32, float, scratch)[CELT_MAX_FRAME_SIZE];
+} OpusEncContext;
+
+static void opus_write_extradata(AVCodecContext *avctx)
+{
+    uint8_t *p = avctx->extradata;
+
+    bytestream_put_buffer(&p, "OpusHead", 8);
+    bytestream_put_byte(&p, 1); /* Version */
+    bytestream_put_byte(&p, avctx->channels);
+    bytestream_put_le16(&p, avctx->initial_padding); /* Lookahead samples at 48kHz */
+    bytestream_put_le32(&p, avctx->sample_rate); /* Original sample rate */
+    bytestream_put_le16(&p, 0); /* Gain of 0dB is recommended. */
+    bytestream_put_byte(&p, 0); /* Channel mapping family */
+}
+
+static void celt_enc_preemphasis(OpusEncContext *s, const AVFrame *frame)
+{
+    const int nb_samples = frame ? frame->nb_samples : 0;
+    int ch, i;
+
+    for (ch = 0; ch < s->channels; ch++) {
+        const float *src = frame ? (const float *)frame->extended_data[ch] : NULL;
+        float *dst = s->samples[ch];
+        float m    = s->preemph_mem[ch];
+
+        memmove(dst, dst + CELT_MAX_FRAME_SIZE, CELT_OVERLAP * sizeof(*dst));
+        dst += CELT_OVERLAP;
+
+        for (i = 0; i < CELT_MAX_FRAME_SIZE; i++) {
+            float x = i < nb_samples ? src[i] * 32768.0f : 0.0f;
+            dst[i] = x - m;
+            m      = x * CELT_DEEMPH_COEFF;
+        }
+        s->preemph_mem[ch] = m;
+    }
+}
+
+/**
+ * Forward MDCT, the transpose of the decoder's imdct_half() followed by the
+ * low-overlap vector_fmul_window() overlap-add.
+ */
+static void celt_enc_mdct(OpusEncContext *s, int ch)
+{
+    const int N = CELT_MAX_FRAME_SIZE, ov2 = CELT_OVERLAP / 2;
+    const float *win = ff_celt_window;
+    const float *in  = s->samples[ch];
+    float *out = s->coeffs[ch];
+    float *tmp = s->fold;
+    int j;
+
+    /* fold the overlapping edges in, alternating the sign to turn the
+     * decoder's transform into its own transpose */
+    for (j = 0; j < ov2; j++) {
+        tmp[j]         = win[ov2 + j]     * in[ov2 + j] -
+                         win[ov2 - 1 - j] * in[ov2 - 1 - j];
+        tmp[N - 1 - j] = win[ov2 + j]     * in[N + ov2 - 1 - j] +
+                         win[ov2 - 1 - j] * in[N + ov2 + j];
+    }
+    memcpy(tmp + ov2, in + CELT_OVERLAP, (N - CELT_OVERLAP) * sizeof(*tmp));
+    for (j = 1; j < N; j += 2)
+        tmp[j] = -tmp[j];
+
+    s->imdct->imdct_half(s->imdct, s->scratch, tmp, 1, 2.0f / N);
+
+    for (j = 0; j < N; j += 2) {
+        out[j]     =  s->scratch[j];
+        out[j + 1] = -s->scratch[j + 1];
+    }
+}
+
+static void celt_enc_band_energy(OpusEncContext *s)
+{
+    int ch, i, j;
+
+    for (ch = 0; ch < s->channels; ch++) {
+        for (i = 0; i < CELT_MAX_BANDS; i++) {
+            float *X = s->coeffs[ch] + (ff_celt_freq_bands[i] << OPUS_ENC_DURATION);
+            const int N = ff_celt_freq_range[i] << OPUS_ENC_DURATION;
+            float amp = sqrtf(s->dsp->scalarproduct_float(X, X, N) + 1e-27f);
+            float g   = 1.0f / amp;
+
+            s->band_amp[ch][i]    = amp;
+            s->band_energy[ch][i] = FFMAX(log2f(amp) - ff_celt_mean_energy[i],
+                                          CELT_ENERGY_SILENCE);
+            for (j = 0; j < N; j++)
+                X[j] *= g;
+        }
+    }
+}
+
+static void celt_enc_coarse_energy(OpusEncContext *s, OpusRangeCoder *rc)
+{
+    const int C = s->channels;
+    float prev[2] = { 0 };
+    float alpha, beta;
+    const uint8_t *model;
+    int i, ch, intra = s->intra;
+
+    if (opus_rc_tell(rc) + 3 <= s->framebits)
+        ff_opus_rc_enc_log(rc, intra, 3);
+    else
+        intra = 0;
+
+    if (intra) {
+        alpha = 0;
+        beta  = 1.0f - 4915.0f/32768.0f;
+        model = ff_celt_coarse_energy_dist[OPUS_ENC_DURATION][1];
+    } else {
+        alpha = ff_celt_alpha_coef[OPUS_ENC_DURATION];
+        beta  = 1.0f - ff_celt_beta_coef[OPUS_ENC_DURATION];
+        model = ff_celt_coarse_energy_dist[OPUS_ENC_DURATION][0];
+    }
+
+    for (i = 0; i < CELT_MAX_BANDS; i++) {
+        for (ch = 0; ch < C; ch++) {
+            const int available = s->framebits - opus_rc_tell(rc);
+            const int bits_left = available - 3 * C * (CELT_MAX_BANDS - i);
+            float old = FFMAX(-9.0f, s->energy[ch][i]);
+            float f   = s->band_energy[ch][i] - alpha * old - prev[ch];
+            int qi    = (int)floorf(f + 0.5f);
+
+            /* keep enough bits around to code the remaining bands */
+            if (i && bits_left < 30) {
+                if (bits_left < 24)
+                    qi = FFMIN(1, qi);
+                if (bits_left < 16)
+                    qi = FFMAX(-1, qi);
+            }
+
+            if (available >= 15) {
+                int k = FFMIN(i, 20) << 1;
+                ff_opus_rc_enc_laplace(rc, &qi, model[k] << 7, model[k+1] << 6);
+            } else if (available >= 2) {
+                qi = av_clip(qi, -1, 1);
+                ff_opus_rc_enc_cdf(rc, 2 * qi ^ -(qi < 0), ff_celt_model_energy_small);
+            } else if (available >= 1) {
+                qi = FFMIN(0, qi);
+                ff_opus_rc_enc_log(rc, -qi, 1);
+            } else {
+                qi = -1;
+            }
+
+            s->energy[ch][i] = old * alpha + prev[ch] + qi;
+            s->error[ch][i]  = f - qi;
+            prev[ch]        += beta * qi;
+        }
+    }
+
+    s->intra = 0;
+}
+
+static void celt_enc_tf_changes(OpusEncContext *s, OpusRangeCoder *rc)
+{
+    int i, bits = 4, consumed, tf_select_bit;
+
+    /* keep the default resolution in every band */
+    consumed      = opus_rc_tell(rc);
+    tf_select_bit = consumed + bits + 1 <= s->framebits;
+
+    for (i = 0; i < CELT_MAX_BANDS; i++) {
+        if (consumed + bits + tf_select_bit <= s->framebits) {
+            ff_opus_rc_enc_log(rc, 0, bits);
+            consumed = opus_rc_tell(rc);
+        }
+        bits = 5;
+    }
+
+    if (tf_select_bit && ff_celt_tf_select[OPUS_ENC_DURATION][0][0][0] !=
+                         ff_celt_tf_select[OPUS_ENC_DURATION][0][1][0])
+        ff_opus_rc_enc_log(rc, 0, 1);
+}
+
+static void celt_enc_allocation(OpusEncContext *s, OpusRangeCoder *rc)
+{
+    const int C = s->channels, duration = OPUS_ENC_DURATION;
+    int cap[CELT_MAX_BANDS];
+    int threshold[CELT_MAX_BANDS];
+    int bits1[CELT_MAX_BANDS];
+    int bits2[CELT_MAX_BANDS];
+    int trim_offset[CELT_MAX_BANDS];
+
+    int alloctrim = 5;
+    int extrabits = 0;
+
+    int skip_bit            = 0;
+    int intensitystereo_bit = 0;
+    int dualstereo_bit      = 0;
+
+    int remaining, bandbits;
+    int low, high, total, done;
+    int totalbits;
+    int consumed;
+    int i, j;
+
+    consumed = opus_rc_tell(rc);
+
+    s->spread = CELT_SPREAD_NORMAL;
+    if (consumed + 4 <= s->framebits)
+        ff_opus_rc_enc_cdf(rc, s->spread, ff_celt_model_spread);
+
+    for (i = 0; i < CELT_MAX_BANDS; i++) {
+        cap[i] = (ff_celt_static_caps[duration][C - 1][i] + 64)
+                 * ff_celt_freq_range[i] << (C - 1) << duration >> 2;
+    }
+
+    /* no band boost */
+    totalbits = s->framebits << 3;
+    consumed  = opus_rc_tell_frac(rc);
+    for (i = 0; i < CELT_MAX_BANDS; i++) {
+        if (consumed + (6 << 3) < totalbits && cap[i] > 0) {
+            ff_opus_rc_enc_log(rc, 0, 6);
+            consumed = opus_rc_tell_frac(rc);
+        }
+    }
+
+    if (consumed + (6 << 3) <= totalbits)
+        ff_opus_rc_enc_cdf(rc, alloctrim, ff_celt_model_alloc_trim);
+
+    /* long blocks never need the anti-collapse bit */
+    totalbits = (s->framebits << 3) - opus_rc_tell_frac(rc) - 1;
+
+    if (totalbits >= 1 << 3)
+        skip_bit = 1 << 3;
+    totalbits -= skip_bit;
+
+    if (C == 2) {
+        intensitystereo_bit = ff_celt_log2_frac[CELT_MAX_BANDS];
+        if (intensitystereo_bit <= totalbits) {
+            totalbits -= intensitystereo_bit;
+            if (totalbits >= 1 << 3) {
+                dualstereo_bit = 1 << 3;
+                totalbits -= 1 << 3;
+            }
+        } else
+            intensitystereo_bit = 0;
+    }
+
+    for (i = 0; i < CELT_MAX_BANDS; i++) {
+        int trim  = alloctrim - 5 - duration;
+        int band  = ff_celt_freq_range[i] * (CELT_MAX_BANDS - i - 1);
+        int scale = duration + 3 + C - 1;
+
+        threshold[i] = FFMAX(3 * ff_celt_freq_range[i] << (duration + 3) >> 4, C << 3);
+
+        trim_offset[i] = trim * (band << scale) >> 6;
+
+        if (ff_celt_freq_range[i] << duration == 1)
+            trim_offset[i] -= C << 3;
+    }
+
+    low  = 1;
+    high = CELT_VECTORS - 1;
+    while (low <= high) {
+        int center = (low + high) >> 1;
+        done = total = 0;
+
+        for (i = CELT_MAX_BANDS - 1; i >= 0; i--) {
+            bandbits = ff_celt_freq_range[i] * ff_celt_static_alloc[center][i]
+                       << (C - 1) << duration >> 2;
+
+            if (bandbits)
+                bandbits = FFMAX(0, bandbits + trim_offset[i]);
+
+            if (bandbits >= threshold[i] || done) {
+                done = 1;
+                total += FFMIN(bandbits, cap[i]);
+            } else if (bandbits >= C << 3)
+                total += C << 3;
+        }
+
+        if (total > totalbits)
+            high = center - 1;
+        else
+            low = center + 1;
+    }
+    high = low--;
+
+    for (i = 0; i < CELT_MAX_BANDS; i++) {
+        bits1[i] = ff_celt_freq_range[i] * ff_celt_static_alloc[low][i]
+                   << (C - 1) << duration >> 2;
+        bits2[i] = high >= CELT_VECTORS ? cap[i] :
+                   ff_celt_freq_range[i] * ff_celt_static_alloc[high][i]
+                   << (C - 1) << duration >> 2;
+
+        if (bits1[i])
+            bits1[i] = FFMAX(0, bits1[i] + trim_offset[i]);
+        if (bits2[i])
+            bits2[i] = FFMAX(0, bits2[i] + trim_offset[i]);
+        bits2[i] = FFMAX(0, bits2[i] - bits1[i]);
+    }
+
+    low  = 0;
+    high = 1 << CELT_ALLOC_STEPS;
+    for (i = 0; i < CELT_ALLOC_STEPS; i++) {
+        int center = (low + high) >> 1;
+        done = total = 0;
+
+        for (j = CELT_MAX_BANDS - 1; j >= 0; j--) {
+            bandbits = bits1[j] + (center * bits2[j] >> CELT_ALLOC_STEPS);
+
+            if (bandbits >= threshold[j] || done) {
+                done = 1;
+                total += FFMIN(bandbits, cap[j]);
+            } else if (bandbits >= C << 3)
+                total += C << 3;
+        }
+        if (total > totalbits)
+            high = center;
+        else
+            low = center;
+    }
+
+    done = total = 0;
+    for (i = CELT_MAX_BANDS - 1; i >= 0; i--) {
+        bandbits = bits1[i] + (low * bits2[i] >> CELT_ALLOC_STEPS);
+
+        if (bandbits >= threshold[i] || done)
+            done = 1;
+        else
+            bandbits = (bandbits >= C << 3) ? C << 3 : 0;
+
+        bandbits     = FFMIN(bandbits, cap[i]);
+        s->pulses[i] = bandbits;
+        total       += bandbits;
+    }
+
+    /* code every band the decoder would allow us to */
+    for (s->codedbands = CELT_MAX_BANDS; ; s->codedbands--) {
+        int allocation;
+        j = s->codedbands - 1;
+
+        if (j == 0) {
+            totalbits += skip_bit;
+            break;
+        }
+
+        remaining   = totalbits - total;
+        bandbits    = remaining / ff_celt_freq_bands[j+1];
+        remaining  -= bandbits  * ff_celt_freq_bands[j+1];
+        allocation  = s->pulses[j] + bandbits * ff_celt_freq_range[j]
+                      + FFMAX(0, remaining - ff_celt_freq_bands[j]);
+
+        if (allocation >= FFMAX(threshold[j], (C + 1) << 3)) {
+            ff_opus_rc_enc_log(rc, 1, 1);
+            break;
+        }
+
+        total -= s->pulses[j];
+        if (intensitystereo_bit) {
+            total -= intensitystereo_bit;
+            intensitystereo_bit = ff_celt_log2_frac[j];
+            total += intensitystereo_bit;
+        }
+
+        total += s->pulses[j] = (allocation >= C << 3) ? C << 3 : 0;
+    }
+
+    /* dual stereo over all coded bands when the bits for signalling it are
+     * available, otherwise intensity stereo over the whole frame */
+    s->intensitystereo = 0;
+    s->dualstereo      = 0;
+    if (intensitystereo_bit) {
+        s->intensitystereo = dualstereo_bit ? s->codedbands : 0;
+        ff_opus_rc_enc_uint(rc, s->intensitystereo, s->codedbands + 1);
+    }
+    if (s->intensitystereo <= 0)
+        totalbits += dualstereo_bit;
+    else if (dualstereo_bit) {
+        s->dualstereo = 1;
+        ff_opus_rc_enc_log(rc, 1, 1);
+    }
+
+    remaining  = totalbits - total;
+    bandbits   = remaining / ff_celt_freq_bands[s->codedbands];
+    remaining -= bandbits * ff_celt_freq_bands[s->codedbands];
+    for (i = 0; i < s->codedbands; i++) {
+        int bits = FFMIN(remaining, ff_celt_freq_range[i]);
+
+        s->pulses[i] += bits + bandbits * ff_celt_freq_range[i];
+        remaining    -= bits;
+    }
+
+    for (i = 0; i < s->codedbands; i++) {
+        int N = ff_celt_freq_range[i] << duration;
+        int prev_extra = extrabits;
+        s->pulses[i] += extrabits;
+
+        if (N > 1) {
+            int dof, temp, offset, fine_bits, max_bits;
+
+            extrabits = FFMAX(0, s->pulses[i] - cap[i]);
+            s->pulses[i] -= extrabits;
+
+            dof = N * C + (C == 2 && N > 2 && !s->dualstereo && i < s->intensitystereo);
+            temp = dof * (ff_celt_log_freq_range[i] + (duration << 3));
+            offset = (temp >> 1) - dof * CELT_FINE_OFFSET;
+            if (N == 2)
+                offset += dof << 1;
+
+            if (s->pulses[i] + offset < 2 * (dof << 3))
+                offset += temp >> 2;
+            else if (s->pulses[i] + offset < 3 * (dof << 3))
+                offset += temp >> 3;
+
+            fine_bits = (s->pulses[i] + offset + (dof << 2)) / (dof << 3);
+            max_bits  = FFMIN((s->pulses[i] >> 3) >> (C - 1), CELT_MAX_FINE_BITS);
+            max_bits  = FFMAX(max_bits, 0);
+
+            s->fine_bits[i]     = av_clip(fine_bits, 0, max_bits);
+            s->fine_priority[i] = (s->fine_bits[i] * (dof << 3) >= s->pulses[i] + offset);
+            s->pulses[i]       -= s->fine_bits[i] << (C - 1) << 3;
+        } else {
+            extrabits = FFMAX(0, s->pulses[i] - (C << 3));
+            s->pulses[i] -= extrabits;
+            s->fine_bits[i] = 0;
+            s->fine_priority[i] = 1;
+        }
+
+        if (extrabits > 0) {
+            int fineextra = FFMIN(extrabits >> (C + 2),
+                                  CELT_MAX_FINE_BITS - s->fine_bits[i]);
+            s->fine_bits[i] += fineextra;
+
+            fineextra <<= C + 2;
+            s->fine_priority[i] = (fineextra >= extrabits - prev_extra);
+            extrabits -= fineextra;
+        }
+    }
+    s->remaining = extrabits;
+
+    for (; i < CELT_MAX_BANDS; i++) {
+        s->fine_bits[i]     = s->pulses[i] >> (C - 1) >> 3;
+        s->pulses[i]        = 0;
+        s->fine_priority[i] = s->fine_bits[i] < 1;
+    }
+}
+
+static void celt_enc_fine_energy(OpusEncContext *s, OpusRangeCoder *rc)
+{
+    int i, ch;
+
+    for (i = 0; i < CELT_MAX_BANDS; i++) {
+        const int fine_bits = s->fine_bits[i];
+        if (!fine_bits)
+            continue;
+
+        for (ch = 0; ch < s->channels; ch++) {
+            int q2 = av_clip((int)floorf((s->error[ch][i] + 0.5f) * (1 << fine_bits)),
+                             0, (1 << fine_bits) - 1);
+            float offset = (q2 + 0.5f) * (1 << (14 - fine_bits)) / 16384.0f - 0.5f;
+
+            ff_opus_rc_put_raw(rc, q2, fine_bits);
+            s->energy[ch][i] += offset;
+            s->error[ch][i]  -= offset;
+        }
+    }
+}
+
+static void celt_enc_final_energy(OpusEncContext *s, OpusRangeCoder *rc)
+{
+    int bits_left = s->framebits - opus_rc_tell(rc);
+    int priority, i, ch;
+
+    for (priority = 0; priority < 2; priority++) {
+        for (i = 0; i < CELT_MAX_BANDS && bits_left >= s->channels; i++) {
+            if (s->fine_priority[i] != priority || s->fine_bits[i] >= CELT_MAX_FINE_BITS)
+                continue;
+
+            for (ch = 0; ch < s->channels; ch++) {
+                int q2 = s->error[ch][i] >= 0;
+                float offset = (q2 - 0.5f) * (1 << (14 - s->fine_bits[i] - 1)) / 16384.0f;
+
+                ff_opus_rc_put_raw(rc, q2, 1);
+                s->energy[ch][i] += offset;
+                s->error[ch][i]  -= offset;
+                bits_left--;
+            }
+        }
+    }
+}
+
+/**
+ * Greedy PVQ search for the K-pulse vector closest in angle to X.
+ */
+static void celt_pvq_search(const float *X, int *y, int K, int N)
+{
+    float ax[176], yy2[176];
+    float xy = 0.0f, yy = 0.0f;
+    int i, j, pulses_left = K;
+
+    for (j = 0; j < N; j++) {
+        ax[j]  = fabsf(X[j]);
+        y[j]   = 0;
+        yy2[j] = 0.0f;
+    }
+
+    /* project onto the pyramid first when there are many pulses */
+    if (K > (N >> 1)) {
+        float sum = 0.0f, rcp;
+
+        for (j = 0; j < N; j++)
+            sum += ax[j];
+        if (sum <= 1e-15f) {
+            ax[0] = 1.0f;
+            for (j = 1; j < N; j++)
+                ax[j] = 0.0f;
+            sum = 1.0f;
+        }
+
+        rcp = (K + 0.8f) / sum;
+        for (j = 0; j < N; j++) {
+            y[j]   = floorf(rcp * ax[j]);
+            yy    += y[j] * y[j];
+            xy    += ax[j] * y[j];
+            yy2[j] = 2 * y[j];
+            pulses_left -= y[j];
+        }
+    }
+
+    /* far too many pulses left, dump them in the first bin */
+    if (pulses_left > N + 3) {
+        yy    += pulses_left * pulses_left + pulses_left * yy2[0];
+        y[0]  += pulses_left;
+        yy2[0] = 2 * y[0];
+        pulses_left = 0;
+    }
+
+    for (i = 0; i < pulses_left; i++) {
+        float best_num, best_den;
+        int best = 0;
+
+        yy += 1.0f;
+        best_num = (xy + ax[0]) * (xy + ax[0]);
+        best_den = yy + yy2[0];
+        for (j = 1; j < N; j++) {
+            float num = (xy + ax[j]) * (xy + ax[j]);
+            float den = yy + yy2[j];
+            if (best_den * num > den * best_num) {
+                best_num = num;
+                best_den = den;
+                best     = j;
+            }
+        }
+
+        xy        += ax[best];
+        yy        += yy2[best];
+        yy2[best] += 2.0f;
+        y[best]++;
+    }
+
+    for (j = 0; j < N; j++)
+        if (X[j] < 0)
+            y[j] = -y[j];
+}
+
+/**
+ * Low complexity PVQ search: round the projection of X onto the pyramid and
+ * only walk the few pulses the rounding got wrong, instead of placing every
+ * pulse with a full search over the band.
+ */
+static void celt_pvq_search_fast(const float *X, int *y, int K, int N)
+{
+    float ax[176], sum = 0.0f, rcp;
+    int j, pulses = 0;
+
+    for (j = 0; j < N; j++) {
+        ax[j] = fabsf(X[j]);
+        sum  += ax[j];
+    }
+    if (sum <= 1e-15f) {
+        memset(y, 0, N * sizeof(*y));
+        y[0] = X[0] < 0 ? -K : K;
+        return;
+    }
+
+    rcp = K / sum;
+    for (j = 0; j < N; j++) {
+        y[j]    = lrintf(rcp * ax[j]);
+        pulses += y[j];
+    }
+
+    /* take pulses from the bins rounded up the furthest */
+    while (pulses > K) {
+        float worst = -1.0f;
+        int best = 0;
+        for (j = 0; j < N; j++) {
+            float over = y[j] - rcp * ax[j];
+            if (y[j] && over > worst) {
+                worst = over;
+                best  = j;
+            }
+        }
+        y[best]--;
+        pulses--;
+    }
+
+    /* and give the missing ones to the bins rounded down the furthest */
+    while (pulses < K) {
+        float worst = -1.0f;
+        int best = 0;
+        for (j = 0; j < N; j++) {
+            float under = rcp * ax[j] - y[j];
+            if (under > worst) {
+                worst = under;
+                best  = j;
+            }
+        }
+        y[best]++;
+        pulses++;
+    }
+
+    for (j = 0; j < N; j++)
+        if (X[j] < 0)
+            y[j] = -y[j];
+}
+
+/**
+ * Index of a pulse vector, the inverse of celt_cwrsi() in the decoder.
+ */
+static uint32_t celt_icwrs(int N, const int *y)
+{
+    uint32_t i;
+    int j = N - 1, k;
+
+    i = y[j] < 0;
+    k = FFABS(y[j]);
+    do {
+        j--;
+        i += CELT_PVQ_U(N - j, k);
+        k += FFABS(y[j]);
+        if (y[j] < 0)
+            i += CELT_PVQ_U(N - j, k + 1);
+    } while (j > 0);
+
+    return i;
+}
+
+static void celt_alg_quant(OpusRangeCoder *rc, float *X, int N, int K,
+                           enum CeltSpread spread, int fast)
+{
+    int y[176];
+
+    celt_exp_rotation(X, N, 1, K, spread, 1);
+    if (fast)
+        celt_pvq_search_fast(X, y, K, N);
+    else
+        celt_pvq_search(X, y, K, N);
+    ff_opus_rc_enc_uint(rc, celt_icwrs(N, y), CELT_PVQ_V(N, K));
+}
+
+/**
+ * Code the normalised shape of a single channel band, see celt_decode_band()
+ * for the bit accounting this has to match.
+ */
+static void celt_enc_band(OpusEncContext *s, OpusRangeCoder *rc, const int band,
+                          float *X, int N, int b, int duration)
+{
+    const uint8_t *cache;
+
+    if (N == 1) {
+        if (s->remaining2 >= 1 << 3) {
+            ff_opus_rc_put_raw(rc, X[0] < 0, 1);
+            s->remaining2 -= 1 << 3;
+        }
+        return;
+    }
+
+    cache = ff_celt_cache_bits +
+            ff_celt_cache_index[(duration + 1) * CELT_MAX_BANDS + band];
+    if (duration >= 0 && b > cache[cache[0]] + 12 && N > 2) {
+        float *Y;
+        int qn, itheta = 0, mbits, sbits, delta, qalloc;
+        int pulse_cap, offset, tell, rebalance, j;
+
+        N >>= 1;
+        Y = X + N;
+        duration -= 1;
+
+        pulse_cap = ff_celt_log_freq_range[band] + duration * 8;
+        offset    = (pulse_cap >> 1) - CELT_QTHETA_OFFSET;
+        qn        = celt_compute_qn(N, b, offset, pulse_cap, 0);
+        tell      = opus_rc_tell_frac(rc);
+        if (qn != 1) {
+            float emid = 1e-15f, eside = 1e-15f;
+            for (j = 0; j < N; j++) {
+                emid  += X[j] * X[j];
+                eside += Y[j] * Y[j];
+            }
+            itheta = floorf(0.5f + 16384 * 0.63662f * atan2f(sqrtf(eside), sqrtf(emid)));
+            itheta = (itheta * qn + 8192) >> 14;
+            ff_opus_rc_enc_uint_tri(rc, itheta, qn);
+            itheta = itheta * 16384 / qn;
+        }
+        qalloc = opus_rc_tell_frac(rc) - tell;
+        b -= qalloc;
+
+        if (itheta == 0)
+            delta = -16384;
+        else if (itheta == 16384)
+            delta = 16384;
+        else
+            delta = ROUND_MUL16((N - 1) << 7, celt_log2tan(celt_cos(16384 - itheta),
+                                                           celt_cos(itheta)));
+
+        mbits = av_clip((b - delta) / 2, 0, b);
+        sbits = b - mbits;
+        s->remaining2 -= qalloc;
+
+        rebalance = s->remaining2;
+        if (mbits >= sbits) {
+            celt_enc_band(s, rc, band, X, N, mbits, duration);
+            rebalance = mbits - (rebalance - s->remaining2);
+            if (rebalance > 3 << 3 && itheta != 0)
+                sbits += rebalance - (3 << 3);
+            celt_enc_band(s, rc, band, Y, N, sbits, duration);
+        } else {
+            celt_enc_band(s, rc, band, Y, N, sbits, duration);
+            rebalance = sbits - (rebalance - s->remaining2);
+            if (rebalance > 3 << 3 && itheta != 16384)
+                mbits += rebalance - (3 << 3);
+            celt_enc_band(s, rc, band, X, N, mbits, duration);
+        }
+    } else {
+        unsigned int q         = celt_bits2pulses(cache, b);
+        unsigned int curr_bits = celt_pulses2bits(cache, q);
+        s->remaining2 -= curr_bits;
+
+        while (s->remaining2 < 0 && q > 0) {
+            s->remaining2 += curr_bits;
+            curr_bits      = celt_pulses2bits(cache, --q);
+            s->remaining2 -= curr_bits;
+        }
+
+        if (q != 0)
+            celt_alg_quant(rc, X, N, (q < 8) ? q : (8 + (q & 7)) << ((q >> 3) - 1),
+                           s->spread, s->complexity < OPUS_ENC_FAST_COMPLEXITY);
+    }
+}
+
+/**
+ * Intensity stereo band with the side channel dropped, only the amplitude
+ * weighted downmix shape is coded.
+ */
+static void celt_enc_band_intensity(OpusEncContext *s, OpusRangeCoder *rc,
+                                    const int band, int N, int b)
+{
+    const int offset = ff_celt_freq_bands[band] << OPUS_ENC_DURATION;
+    const float *L = s->coeffs[0] + offset, *R = s->coeffs[1] + offset;
+    const float gl = s->band_amp[0][band], gr = s->band_amp[1][band];
+    float *mid = s->scratch;
+    int tell, j;
+
+    for (j = 0; j < N; j++)
+        mid[j] = gl * L[j] + gr * R[j];
+
+    tell = opus_rc_tell_frac(rc);
+    if (b > 2 << 3 && s->remaining2 > 2 << 3)
+        ff_opus_rc_enc_log(rc, 0, 2);
+    b -= opus_rc_tell_frac(rc) - tell;
+    s->remaining2 -= opus_rc_tell_frac(rc) - tell;
+
+    /* itheta == 0, so the side gets no bits and costs nothing */
+    celt_enc_band(s, rc, band, mid, N, av_clip((b + 16384) / 2, 0, b),
+                  OPUS_ENC_DURATION);
+}
+
+static void celt_enc_bands(OpusEncContext *s, OpusRangeCoder *rc)
+{
+    const int totalbits = s->framebits << 3;
+    int i;
+
+    for (i = 0; i < CELT_MAX_BANDS; i++) {
+        const int band_offset = ff_celt_freq_bands[i] << OPUS_ENC_DURATION;
+        const int band_size   = ff_celt_freq_range[i] << OPUS_ENC_DURATION;
+        int consumed = opus_rc_tell_frac(rc);
+        int b;
+
+        if (i)
+            s->remaining -= consumed;
+        s->remaining2 = totalbits - consumed - 1;
+        if (i <= s->codedbands - 1) {
+            int curr_balance = s->remaining / FFMIN(3, s->codedbands - i);
+            b = av_clip_uintp2(FFMIN(s->remaining2 + 1, s->pulses[i] + curr_balance), 14);
+        } else
+            b = 0;
+
+        if (s->dualstereo && i == s->intensitystereo)
+            s->dualstereo = 0;
+
+        if (s->dualstereo) {
+            celt_enc_band(s, rc, i, s->coeffs[0] + band_offset, band_size, b / 2,
+                          OPUS_ENC_DURATION);
+            celt_enc_band(s, rc, i, s->coeffs[1] + band_offset, band_size, b / 2,
+                          OPUS_ENC_DURATION);
+        } else if (s->channels == 2) {
+            celt_enc_band_intensity(s, rc, i, band_size, b);
+        } else {
+            celt_enc_band(s, rc, i, s->coeffs[0] + band_offset, band_size, b,
+                          OPUS_ENC_DURATION);
+        }
+
+        s->remaining += s->pulses[i] + consumed;
+    }
+}
+
+static int celt_encode_frame(OpusEncContext *s, uint8_t *buf, int size)
+{
+    OpusRangeCoder *rc = &s->rc;
+    int ch, i, consumed, silence = 1;
+
+    ff_opus_rc_enc_init(rc, buf, size);
+    s->framebits = size * 8;
+
+    for (ch = 0; ch < s->channels && silence; ch++)
+        for (i = 0; i < CELT_OVERLAP + CELT_MAX_FRAME_SIZE; i++)
+            if (s->samples[ch][i] != 0.0f) {
+                silence = 0;
+                break;
+            }
+
+    consumed = opus_rc_tell(rc);
+    ff_opus_rc_enc_log(rc, silence, 15);
+    if (silence) {
+        for (ch = 0; ch < 2; ch++)
+            for (i = 0; i < CELT_MAX_BANDS; i++)
+                s->energy[ch][i] = CELT_ENERGY_SILENCE;
+        return ff_opus_rc_enc_end(rc);
+    }
+
+    /* no postfilter */
+    if (consumed + 16 <= s->framebits) {
+        ff_opus_rc_enc_log(rc, 0, 1);
+        consumed = opus_rc_tell(rc);
+    }
+
+    /* long blocks only */
+    if (consumed + 3 <= s->framebits)
+        ff_opus_rc_enc_log(rc, 0, 3);
+
+    for (ch = 0; ch < s->channels; ch++)
+        celt_enc_mdct(s, ch);
+    celt_enc_band_energy(s);
+
+    celt_enc_coarse_energy(s, rc);
+    celt_enc_tf_changes   (s, rc);
+    celt_enc_allocation   (s, rc);
+    celt_enc_fine_energy  (s, rc);
+    celt_enc_bands        (s, rc);
+    celt_enc_final_energy (s, rc);
+
+    if (s->channels == 1)
+        memcpy(s->energy[1], s->energy[0], sizeof(s->energy[0]));
+
+    return ff_opus_rc_enc_end(rc);
+}
+
+static int opus_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
+                             const AVFrame *frame, int *got_packet_ptr)
+{
+    OpusEncContext *s = avctx->priv_data;
+    int ret;
+
+    if (frame) {
+        if ((ret = ff_af_queue_add(&s->afq, frame)) < 0)
+            return ret;
+    } else if (!s->afq.frame_count) {
+        return 0;
+    }
+
+    celt_enc_preemphasis(s, frame);
+
+    if ((ret = ff_alloc_packet2(avctx, avpkt, s->frame_bytes + 1, 0)) < 0)
+        return ret;
+
+    avpkt->data[0] = OPUS_ENC_TOC | ((s->channels == 2) << 2);
+    if ((ret = celt_encode_frame(s, avpkt->data + 1, s->frame_bytes)) < 0) {
+        av_log(avctx, AV_LOG_ERROR, "CELT frame overflowed its budget\n");
+        return ret;
+    }
+
+    ff_af_queue_remove(&s->afq, avctx->frame_size, &avpkt->pts,
+                       &avpkt->duration);
+
+    *got_packet_ptr = 1;
+    return 0;
+}
+
+static av_cold int opus_encode_end(AVCodecContext *avctx)
+{
+    OpusEncContext *s = avctx->priv_data;
+
+    ff_imdct15_uninit(&s->imdct);
+    ff_af_queue_close(&s->afq);
+    av_freep(&s->dsp);
+
+    return 0;
+}
+
+static av_cold int opus_encode_init(AVCodecContext *avctx)
+{
+    OpusEncContext *s = avctx->priv_data;
+    int ret;
+
+    s->avctx    = avctx;
+    s->channels = avctx->channels;
+    s->intra    = 1;
+
+    if (s->channels < 1 || s->channels > 2) {
+        av_log(avctx, AV_LOG_ERROR, "Unsupported number of channels: %d\n",
+               s->channels);
+        return AVERROR(EINVAL);
+    }
+
+    if (avctx->compression_level == FF_COMPRESSION_DEFAULT) {
+        s->complexity = 10;
+    } else if (avctx->compression_level < 0 || avctx->compression_level > 10) {
+        av_log(avctx, AV_LOG_WARNING,
+               "Compression level must be in the range 0 to 10. "
+               "Defaulting to 10.\n");
+        s->complexity = 10;
+    } else {
+        s->complexity = avctx->compression_level;
+    }
+
+    if (!avctx->bit_rate) {
+        avctx->bit_rate = 64000 * s->channels;
+        av_log(avctx, AV_LOG_WARNING,
+               "No bit rate set. Defaulting to %"PRId64" bps.\n",
+               (int64_t)avctx->bit_rate);
+    }
+    if (avctx->bit_rate < 16000 * s->channels || avctx->bit_rate > 510000) {
+        av_log(avctx, AV_LOG_ERROR, "The bit rate %"PRId64" bps is unsupported. "
+               "Please choose a value between %d and 510000.\n",
+               (int64_t)avctx->bit_rate, 16000 * s->channels);
+        return AVERROR(EINVAL);
+    }
+
+    /* one byte of each packet goes to the TOC */
+    s->frame_bytes  = avctx->bit_rate * CELT_MAX_FRAME_SIZE / (48000 * 8) - 1;
+    avctx->bit_rate = (s->frame_bytes + 1) * 48000 * 8 / CELT_MAX_FRAME_SIZE;
+
+    avctx->frame_size      = CELT_MAX_FRAME_SIZE;
+    avctx->initial_padding = CELT_OVERLAP;
+
+    avctx->extradata = av_mallocz(19 + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!avctx->extradata)
+        return AVERROR(ENOMEM);
+    avctx->extradata_size = 19;
+    opus_write_extradata(avctx);
+
+    s->dsp = avpriv_float_dsp_alloc(avctx->flags & AV_CODEC_FLAG_BITEXACT);
+    if (!s->dsp)
+        return AVERROR(ENOMEM);
+
+    if ((ret = ff_imdct15_init(&s->imdct, OPUS_ENC_DURATION + 3)) < 0)
+        return ret;
+
+    ff_af_queue_init(avctx, &s->afq);
+
+    return 0;
+}
+
+static const AVCodecDefault opusenc_defaults[] = {
+    { "b", "0" },
+    { NULL },
+};
+
+AVCodec ff_opus_encoder = {
+    .name            = "opus",
+    .long_name       = NULL_IF_CONFIG_SMALL("Opus"),
+    .type            = AVMEDIA_TYPE_AUDIO,
+    .id              = AV_CODEC_ID_OPUS,
+    .priv_data_size  = sizeof(OpusEncContext),
+    .init            = opus_encode_init,
+    .encode2         = opus_encode_frame,
+    .close           = opus_encode_end,
+    .capabilities    = AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SMALL_LAST_FRAME |
+                       AV_CODEC_CAP_EXPERIMENTAL,
+    .caps_internal   = FF_CODEC_CAP_INIT_THREADSAFE | FF_CODEC_CAP_INIT_CLEANUP,
+    .defaults        = opusenc_defaults,
+    .supported_samplerates = (const int []){ 48000, 0 },
+    .channel_layouts = (const uint64_t []){ AV_CH_LAYOUT_MONO,
+                                            AV_CH_LAYOUT_STEREO, 0 },
+    .sample_fmts     = (const enum AVSampleFormat[]){ AV_SAMPLE_FMT_FLTP,
+                                                      AV_SAMPLE_FMT_NONE },
+};
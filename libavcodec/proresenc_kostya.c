@@ -31,6 +31,7 @@
 #include "bytestream.h"
 #include "internal.h"
 #include "proresdata.h"
+#include "proresencdsp.h"
 
 #define CFACTOR_Y422 2
 #define CFACTOR_Y444 3
@@ -56,6 +57,11 @@ enum {
     QUANT_MAT_DEFAULT,
 };
 
+enum {
+    QUANT_SEARCH_TRELLIS = 0,
+    QUANT_SEARCH_FAST,
+};
+
 static const uint8_t prores_quant_matrices[][64] = {
     { // proxy
          4,  7,  9, 11, 13, 14, 15, 63,
@@ -181,6 +187,7 @@ struct TrellisNode {
 
 typedef struct ProresThreadData {
     DECLARE_ALIGNED(16, int16_t, blocks)[MAX_PLANES][64 * 4 * MAX_MBS_PER_SLICE];
+    DECLARE_ALIGNED(32, int16_t, levels)[64 * 4 * MAX_MBS_PER_SLICE];
     DECLARE_ALIGNED(16, uint16_t, emu_buf)[16 * 16];
     int16_t custom_q[64];
     struct TrellisNode *nodes;
@@ -189,6 +196,7 @@ typedef struct ProresThreadData {
 typedef struct ProresContext {
     AVClass *class;
     DECLARE_ALIGNED(16, int16_t, blocks)[MAX_PLANES][64 * 4 * MAX_MBS_PER_SLICE];
+    DECLARE_ALIGNED(32, int16_t, levels)[64 * 4 * MAX_MBS_PER_SLICE];
     DECLARE_ALIGNED(16, uint16_t, emu_buf)[16*16];
     int16_t quants[MAX_STORED_Q][64];
     int16_t custom_q[64];
@@ -198,6 +206,7 @@ typedef struct ProresContext {
     void (*fdct)(FDCTDSPContext *fdsp, const uint16_t *src,
                  int linesize, int16_t *block);
     FDCTDSPContext fdsp;
+    ProresEncDSPContext dsp;
 
     const AVFrame *pic;
     int mb_width, mb_height;
@@ -215,6 +224,7 @@ typedef struct ProresContext {
 
     char *vendor;
     int quant_sel;
+    int quant_search;
 
     int frame_size_upper_bound;
 
@@ -386,10 +396,10 @@ static void encode_dcs(PutBitContext *pb, int16_t *blocks,
     }
 }
 
-static void encode_acs(PutBitContext *pb, int16_t *blocks,
+static void encode_acs(PutBitContext *pb, const int16_t *levels,
                        int blocks_per_slice,
                        int plane_size_factor,
-                       const uint8_t *scan, const int16_t *qmat)
+                       const uint8_t *scan)
 {
     int idx, i;
     int run, level, run_cb, lev_cb;
@@ -402,7 +412,7 @@ static void encode_acs(PutBitContext *pb, int16_t *blocks,
 
     for (i = 1; i < 64; i++) {
         for (idx = scan[i]; idx < max_coeffs; idx += 64) {
-            level = blocks[idx] / qmat[scan[i]];
+            level = levels[idx];
             if (level) {
                 abs_level = FFABS(level);
                 encode_vlc_codeword(pb, ff_prores_ac_codebook[run_cb], run);
@@ -432,8 +442,9 @@ static int encode_slice_plane(ProresContext *ctx, PutBitContext *pb,
     blocks_per_slice = mbs_per_slice * blocks_per_mb;
 
     encode_dcs(pb, blocks, blocks_per_slice, qmat[0]);
-    encode_acs(pb, blocks, blocks_per_slice, plane_size_factor,
-               ctx->scantable, qmat);
+    ctx->dsp.quantize(ctx->levels, blocks, qmat, blocks_per_slice);
+    encode_acs(pb, ctx->levels, blocks_per_slice, plane_size_factor,
+               ctx->scantable);
     flush_put_bits(pb);
 
     return (put_bits_count(pb) - saved_pos) >> 3;
@@ -633,9 +644,8 @@ static int estimate_dcs(int *error, int16_t *blocks, int blocks_per_slice,
     return bits;
 }
 
-static int estimate_acs(int *error, int16_t *blocks, int blocks_per_slice,
-                        int plane_size_factor,
-                        const uint8_t *scan, const int16_t *qmat)
+static int estimate_acs(const int16_t *levels, int blocks_per_slice,
+                        int plane_size_factor, const uint8_t *scan)
 {
     int idx, i;
     int run, level, run_cb, lev_cb;
@@ -649,8 +659,7 @@ static int estimate_acs(int *error, int16_t *blocks, int blocks_per_slice,
 
     for (i = 1; i < 64; i++) {
         for (idx = scan[i]; idx < max_coeffs; idx += 64) {
-            level   = blocks[idx] / qmat[scan[i]];
-            *error += FFABS(blocks[idx]) % qmat[scan[i]];
+            level = levels[idx];
             if (level) {
                 abs_level = FFABS(level);
                 bits += estimate_vlc(ff_prores_ac_codebook[run_cb], run);
@@ -670,7 +679,6 @@ static int estimate_acs(int *error, int16_t *blocks, int blocks_per_slice,
 }
 
 static int estimate_slice_plane(ProresContext *ctx, int *error, int plane,
-                                const uint16_t *src, int linesize,
                                 int mbs_per_slice,
                                 int blocks_per_mb, int plane_size_factor,
                                 const int16_t *qmat, ProresThreadData *td)
@@ -681,8 +689,10 @@ static int estimate_slice_plane(ProresContext *ctx, int *error, int plane,
     blocks_per_slice = mbs_per_slice * blocks_per_mb;
 
     bits  = estimate_dcs(error, td->blocks[plane], blocks_per_slice, qmat[0]);
-    bits += estimate_acs(error, td->blocks[plane], blocks_per_slice,
-                         plane_size_factor, ctx->scantable, qmat);
+    *error += ctx->dsp.quantize(td->levels, td->blocks[plane], qmat,
+                                blocks_per_slice);
+    bits += estimate_acs(td->levels, blocks_per_slice,
+                         plane_size_factor, ctx->scantable);
 
     return FFALIGN(bits, 8);
 }
@@ -703,7 +713,6 @@ static int est_alpha_diff(int cur, int prev, int abits)
 }
 
 static int estimate_alpha_plane(ProresContext *ctx, int *error,
-                                const uint16_t *src, int linesize,
                                 int mbs_per_slice, int quant,
                                 int16_t *blocks)
 {
@@ -746,37 +755,28 @@ static int estimate_alpha_plane(ProresContext *ctx, int *error,
     return bits;
 }
 
-static int find_slice_quant(AVCodecContext *avctx,
-                            int trellis_node, int x, int y, int mbs_per_slice,
-                            ProresThreadData *td)
+static void get_slice_planes(AVCodecContext *avctx, int x, int y,
+                             int mbs_per_slice, ProresThreadData *td,
+                             int *num_cblocks, int *plane_factor)
 {
     ProresContext *ctx = avctx->priv_data;
-    int i, q, pq, xp, yp;
+    int i, xp, yp;
     const uint16_t *src;
     int slice_width_factor = av_log2(mbs_per_slice);
-    int num_cblocks[MAX_PLANES], pwidth;
-    int plane_factor[MAX_PLANES], is_chroma[MAX_PLANES];
-    const int min_quant = ctx->profile_info->min_quant;
-    const int max_quant = ctx->profile_info->max_quant;
-    int error, bits, bits_limit;
-    int mbs, prev, cur, new_score;
-    int slice_bits[TRELLIS_WIDTH], slice_score[TRELLIS_WIDTH];
-    int overquant;
-    uint16_t *qmat;
-    int linesize[4], line_add;
+    int is_chroma, pwidth;
+    int linesize, line_add;
 
     if (ctx->pictures_per_frame == 1)
         line_add = 0;
     else
         line_add = ctx->cur_picture_idx ^ !ctx->pic->top_field_first;
-    mbs = x + mbs_per_slice;
 
     for (i = 0; i < ctx->num_planes; i++) {
-        is_chroma[i]    = (i == 1 || i == 2);
+        is_chroma       = (i == 1 || i == 2);
         plane_factor[i] = slice_width_factor + 2;
-        if (is_chroma[i])
+        if (is_chroma)
             plane_factor[i] += ctx->chroma_factor - 3;
-        if (!is_chroma[i] || ctx->chroma_factor == CFACTOR_Y444) {
+        if (!is_chroma || ctx->chroma_factor == CFACTOR_Y444) {
             xp             = x << 4;
             yp             = y << 4;
             num_cblocks[i] = 4;
@@ -788,21 +788,67 @@ static int find_slice_quant(AVCodecContext *avctx,
             pwidth         = avctx->width >> 1;
         }
 
-        linesize[i] = ctx->pic->linesize[i] * ctx->pictures_per_frame;
-        src = (const uint16_t *)(ctx->pic->data[i] + yp * linesize[i] +
+        linesize = ctx->pic->linesize[i] * ctx->pictures_per_frame;
+        src = (const uint16_t *)(ctx->pic->data[i] + yp * linesize +
                                  line_add * ctx->pic->linesize[i]) + xp;
 
         if (i < 3) {
-            get_slice_data(ctx, src, linesize[i], xp, yp,
+            get_slice_data(ctx, src, linesize, xp, yp,
                            pwidth, avctx->height / ctx->pictures_per_frame,
                            td->blocks[i], td->emu_buf,
-                           mbs_per_slice, num_cblocks[i], is_chroma[i]);
+                           mbs_per_slice, num_cblocks[i], is_chroma);
         } else {
-            get_alpha_data(ctx, src, linesize[i], xp, yp,
+            get_alpha_data(ctx, src, linesize, xp, yp,
                            pwidth, avctx->height / ctx->pictures_per_frame,
                            td->blocks[i], mbs_per_slice, ctx->alpha_bits);
         }
     }
+}
+
+static int estimate_slice_bits(ProresContext *ctx, int *error, int q,
+                               int mbs_per_slice, const int *num_cblocks,
+                               const int *plane_factor, ProresThreadData *td)
+{
+    const int16_t *qmat;
+    int i, bits = 0;
+
+    *error = 0;
+    if (q < MAX_STORED_Q) {
+        qmat = ctx->quants[q];
+    } else {
+        for (i = 0; i < 64; i++)
+            td->custom_q[i] = ctx->quant_mat[i] * q;
+        qmat = td->custom_q;
+    }
+    for (i = 0; i < ctx->num_planes - !!ctx->alpha_bits; i++) {
+        bits += estimate_slice_plane(ctx, error, i, mbs_per_slice,
+                                     num_cblocks[i], plane_factor[i],
+                                     qmat, td);
+    }
+    if (ctx->alpha_bits)
+        bits += estimate_alpha_plane(ctx, error, mbs_per_slice, q,
+                                     td->blocks[3]);
+
+    return bits;
+}
+
+static int find_slice_quant(AVCodecContext *avctx,
+                            int trellis_node, int x, int y, int mbs_per_slice,
+                            ProresThreadData *td)
+{
+    ProresContext *ctx = avctx->priv_data;
+    int q, pq;
+    int num_cblocks[MAX_PLANES], plane_factor[MAX_PLANES];
+    const int min_quant = ctx->profile_info->min_quant;
+    const int max_quant = ctx->profile_info->max_quant;
+    int error, bits, bits_limit;
+    int mbs, prev, cur, new_score;
+    int slice_bits[TRELLIS_WIDTH], slice_score[TRELLIS_WIDTH];
+    int overquant;
+
+    mbs = x + mbs_per_slice;
+
+    get_slice_planes(avctx, x, y, mbs_per_slice, td, num_cblocks, plane_factor);
 
     for (q = min_quant; q < max_quant + 2; q++) {
         td->nodes[trellis_node + q].prev_node = -1;
@@ -811,18 +857,8 @@ static int find_slice_quant(AVCodecContext *avctx,
 
     // todo: maybe perform coarser quantising to fit into frame size when needed
     for (q = min_quant; q <= max_quant; q++) {
-        bits  = 0;
-        error = 0;
-        for (i = 0; i < ctx->num_planes - !!ctx->alpha_bits; i++) {
-            bits += estimate_slice_plane(ctx, &error, i,
-                                         src, linesize[i],
-                                         mbs_per_slice,
-                                         num_cblocks[i], plane_factor[i],
-                                         ctx->quants[q], td);
-        }
-        if (ctx->alpha_bits)
-            bits += estimate_alpha_plane(ctx, &error, src, linesize[3],
-                                         mbs_per_slice, q, td->blocks[3]);
+        bits = estimate_slice_bits(ctx, &error, q, mbs_per_slice,
+                                   num_cblocks, plane_factor, td);
         if (bits > 65000 * 8)
             error = SCORE_LIMIT;
 
@@ -835,25 +871,8 @@ static int find_slice_quant(AVCodecContext *avctx,
         overquant = max_quant;
     } else {
         for (q = max_quant + 1; q < 128; q++) {
-            bits  = 0;
-            error = 0;
-            if (q < MAX_STORED_Q) {
-                qmat = ctx->quants[q];
-            } else {
-                qmat = td->custom_q;
-                for (i = 0; i < 64; i++)
-                    qmat[i] = ctx->quant_mat[i] * q;
-            }
-            for (i = 0; i < ctx->num_planes - !!ctx->alpha_bits; i++) {
-                bits += estimate_slice_plane(ctx, &error, i,
-                                             src, linesize[i],
-                                             mbs_per_slice,
-                                             num_cblocks[i], plane_factor[i],
-                                             qmat, td);
-            }
-            if (ctx->alpha_bits)
-                bits += estimate_alpha_plane(ctx, &error, src, linesize[3],
-                                             mbs_per_slice, q, td->blocks[3]);
+            bits = estimate_slice_bits(ctx, &error, q, mbs_per_slice,
+                                       num_cblocks, plane_factor, td);
             if (bits <= ctx->bits_per_mb * mbs_per_slice)
                 break;
         }
@@ -902,6 +921,48 @@ static int find_slice_quant(AVCodecContext *avctx,
     return pq;
 }
 
+/**
+ * Pick the smallest quantiser that fits the slice into what is left of the
+ * bit budget of the row. The size decreases with the quantiser, so bisection
+ * needs a few estimates per slice instead of one for every allowed quantiser.
+ */
+static int find_slice_quant_fast(AVCodecContext *avctx, int x, int y,
+                                 int mbs_per_slice, int bits_limit,
+                                 int *slice_bits, ProresThreadData *td)
+{
+    ProresContext *ctx = avctx->priv_data;
+    int num_cblocks[MAX_PLANES], plane_factor[MAX_PLANES];
+    int lo = ctx->profile_info->min_quant;
+    int hi = ctx->profile_info->max_quant;
+    int q, bits, error;
+
+    get_slice_planes(avctx, x, y, mbs_per_slice, td, num_cblocks, plane_factor);
+
+    *slice_bits = estimate_slice_bits(ctx, &error, hi, mbs_per_slice,
+                                      num_cblocks, plane_factor, td);
+    if (*slice_bits > bits_limit) {
+        lo = hi + 1;
+        hi = 127;
+        *slice_bits = -1;
+    }
+    while (lo < hi) {
+        q    = (lo + hi) >> 1;
+        bits = estimate_slice_bits(ctx, &error, q, mbs_per_slice,
+                                   num_cblocks, plane_factor, td);
+        if (bits <= bits_limit) {
+            hi          = q;
+            *slice_bits = bits;
+        } else {
+            lo = q + 1;
+        }
+    }
+    if (*slice_bits < 0)
+        *slice_bits = estimate_slice_bits(ctx, &error, lo, mbs_per_slice,
+                                          num_cblocks, plane_factor, td);
+
+    return lo;
+}
+
 static int find_quant_thread(AVCodecContext *avctx, void *arg,
                              int jobnr, int threadnr)
 {
@@ -910,6 +971,21 @@ static int find_quant_thread(AVCodecContext *avctx, void *arg,
     int mbs_per_slice = ctx->mbs_per_slice;
     int x, y = jobnr, mb, q = 0;
 
+    if (ctx->quant_search == QUANT_SEARCH_FAST) {
+        int bits, row_bits = 0;
+
+        for (x = mb = 0; x < ctx->mb_width; x += mbs_per_slice, mb++) {
+            while (ctx->mb_width - x < mbs_per_slice)
+                mbs_per_slice >>= 1;
+            ctx->slice_q[mb + y * ctx->slices_width] =
+                find_slice_quant_fast(avctx, x, y, mbs_per_slice,
+                                      (x + mbs_per_slice) * ctx->bits_per_mb - row_bits,
+                                      &bits, td);
+            row_bits += bits;
+        }
+        return 0;
+    }
+
     for (x = mb = 0; x < ctx->mb_width; x += mbs_per_slice, mb++) {
         while (ctx->mb_width - x < mbs_per_slice)
             mbs_per_slice >>= 1;
@@ -1136,6 +1212,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
     ctx->scantable = interlaced ? ff_prores_interlaced_scan
                                 : ff_prores_progressive_scan;
     ff_fdctdsp_init(&ctx->fdsp, avctx);
+    ff_proresenc_dsp_init(&ctx->dsp);
 
     mps = ctx->mbs_per_slice;
     if (mps & (mps - 1)) {
@@ -1328,6 +1405,12 @@ static const AVOption options[] = {
         0, 0, VE, "quant_mat" },
     { "alpha_bits", "bits for alpha plane", OFFSET(alpha_bits), AV_OPT_TYPE_INT,
         { .i64 = 16 }, 0, 16, VE },
+    { "quant_search", "slice quantiser search", OFFSET(quant_search), AV_OPT_TYPE_INT,
+        { .i64 = QUANT_SEARCH_TRELLIS }, QUANT_SEARCH_TRELLIS, QUANT_SEARCH_FAST, VE, "quant_search" },
+    { "trellis",       "best quantisers for the whole row of slices", 0, AV_OPT_TYPE_CONST,
+        { .i64 = QUANT_SEARCH_TRELLIS }, 0, 0, VE, "quant_search" },
+    { "fast",          "bisect the quantiser of each slice", 0, AV_OPT_TYPE_CONST,
+        { .i64 = QUANT_SEARCH_FAST }, 0, 0, VE, "quant_search" },
     { NULL }
 };
 
@@ -0,0 +1,48 @@
+/*
+ * Apple ProRes encoder DSP functions
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/common.h"
+#include "proresencdsp.h"
+
+/* With both operands below 2^15 the correctly rounded single precision
+ * quotient truncates to the exact integer quotient, which is a lot cheaper
+ * than an integer division. */
+static int prores_quantize_c(int16_t *levels, const int16_t *blocks,
+                             const int16_t *qmat, int nb_blocks)
+{
+    int i, j, level, error = 0;
+
+    for (i = 0; i < nb_blocks; i++, blocks += 64, levels += 64) {
+        levels[0] = (int)((float)blocks[0] / qmat[0]);
+        for (j = 1; j < 64; j++) {
+            level     = (int)((float)blocks[j] / qmat[j]);
+            levels[j] = level;
+            error    += FFABS(blocks[j] - level * qmat[j]);
+        }
+    }
+
+    return error;
+}
+
+av_cold void ff_proresenc_dsp_init(ProresEncDSPContext *dsp)
+{
+    dsp->quantize = prores_quantize_c;
+}
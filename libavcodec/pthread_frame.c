@@ -113,6 +113,15 @@ typedef struct FrameThreadContext {
                                     * Set for the first N packets, where N is the number of threads.
                                     * While it is set, ff_thread_en/decode_frame won't return any results.
                                     */
+
+    AVBufferPool *pkt_pool;        ///< Buffers for copies of non-refcounted input packets.
+    int           pkt_pool_size;   ///< Size of the buffers in pkt_pool.
+
+    /* packet handoff statistics, printed at debug level when closing */
+    unsigned nb_pkt_refs;          ///< Packets passed on by reference.
+    unsigned nb_pkt_copies;        ///< Packets that had to be copied.
+    uint64_t pkt_bytes_copied;     ///< Payload bytes copied.
+    unsigned nb_side_data_reused;  ///< Packets whose side data reused the previous allocation.
 } FrameThreadContext;
 
 #define THREAD_SAFE_CALLBACKS(avctx) \
@@ -307,11 +316,102 @@ static void release_delayed_buffers(PerThreadContext *p)
     }
 }
 
+/**
+ * Copy the packet properties, reusing the side data allocations of the
+ * previous packet of this thread when the layout is the same.
+ */
+static int thread_packet_copy_props(FrameThreadContext *fctx, AVPacket *dst,
+                                    const AVPacket *src)
+{
+    AVPacketSideData *side_data = dst->side_data;
+    int side_data_elems = dst->side_data_elems;
+    AVPacket tmp;
+    int i, ret;
+
+    if (side_data_elems != src->side_data_elems || !side_data_elems) {
+        av_packet_free_side_data(dst);
+        return av_packet_copy_props(dst, src);
+    }
+
+    for (i = 0; i < side_data_elems; i++) {
+        if (side_data[i].type != src->side_data[i].type ||
+            side_data[i].size != src->side_data[i].size) {
+            av_packet_free_side_data(dst);
+            return av_packet_copy_props(dst, src);
+        }
+    }
+
+    tmp = *src;
+    tmp.side_data       = NULL;
+    tmp.side_data_elems = 0;
+    ret = av_packet_copy_props(dst, &tmp);
+
+    for (i = 0; i < side_data_elems; i++)
+        memcpy(side_data[i].data, src->side_data[i].data, src->side_data[i].size);
+    dst->side_data       = side_data;
+    dst->side_data_elems = side_data_elems;
+    fctx->nb_side_data_reused++;
+
+    return ret;
+}
+
+/**
+ * Hand a packet over to a decoding thread.
+ *
+ * Reference-counted input is passed through without touching the payload.
+ * Anything else has to be copied since the caller may reuse its buffer once
+ * we return; the copy goes to a pooled buffer so that large intra-only
+ * packets do not cost an allocation (and fresh page faults) per frame.
+ */
+static int thread_packet_ref(FrameThreadContext *fctx, AVPacket *dst,
+                             const AVPacket *src)
+{
+    av_buffer_unref(&dst->buf);
+    dst->data = NULL;
+    dst->size = 0;
+
+    if (src->buf) {
+        dst->buf = av_buffer_ref(src->buf);
+        if (!dst->buf)
+            return AVERROR(ENOMEM);
+        dst->data = src->data;
+        fctx->nb_pkt_refs++;
+    } else if (src->size) {
+        if (src->size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+            return AVERROR(EINVAL);
+        if (!fctx->pkt_pool ||
+            fctx->pkt_pool_size < src->size + AV_INPUT_BUFFER_PADDING_SIZE) {
+            /* grow with some headroom, outstanding buffers keep the old
+             * pool alive until they are returned; the headroom is clamped
+             * to INT_MAX, which is never below the size needed */
+            int64_t size = src->size + AV_INPUT_BUFFER_PADDING_SIZE;
+            size = FFMIN(size + (size >> 2), INT_MAX);
+            av_buffer_pool_uninit(&fctx->pkt_pool);
+            fctx->pkt_pool = av_buffer_pool_init(size, NULL);
+            if (!fctx->pkt_pool)
+                return AVERROR(ENOMEM);
+            fctx->pkt_pool_size = size;
+        }
+        dst->buf = av_buffer_pool_get(fctx->pkt_pool);
+        if (!dst->buf)
+            return AVERROR(ENOMEM);
+        memcpy(dst->buf->data, src->data, src->size);
+        memset(dst->buf->data + src->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        dst->data = dst->buf->data;
+        fctx->nb_pkt_copies++;
+        fctx->pkt_bytes_copied += src->size;
+    }
+    dst->size = src->size;
+
+    return thread_packet_copy_props(fctx, dst, src);
+}
+
 static int submit_packet(PerThreadContext *p, AVPacket *avpkt)
 {
     FrameThreadContext *fctx = p->parent;
     PerThreadContext *prev_thread = fctx->prev_thread;
     const AVCodec *codec = p->avctx->codec;
+    int err;
 
     if (!avpkt->size && !(codec->capabilities & AV_CODEC_CAP_DELAY))
         return 0;
@@ -321,7 +421,6 @@ static int submit_packet(PerThreadContext *p, AVPacket *avpkt)
     release_delayed_buffers(p);
 
     if (prev_thread) {
-        int err;
         if (prev_thread->state == STATE_SETTING_UP) {
             pthread_mutex_lock(&prev_thread->progress_mutex);
             while (prev_thread->state == STATE_SETTING_UP)
@@ -336,8 +435,12 @@ static int submit_packet(PerThreadContext *p, AVPacket *avpkt)
         }
     }
 
-    av_packet_unref(&p->avpkt);
-    av_packet_ref(&p->avpkt, avpkt);
+    err = thread_packet_ref(fctx, &p->avpkt, avpkt);
+    if (err < 0) {
+        av_packet_unref(&p->avpkt);
+        pthread_mutex_unlock(&p->mutex);
+        return err;
+    }
 
     p->state = STATE_SETTING_UP;
     pthread_cond_signal(&p->input_cond);
@@ -592,6 +695,13 @@ void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
         av_freep(&p->avctx);
     }
 
+    av_log(avctx, AV_LOG_DEBUG,
+           "Frame threads: %u packets passed by reference, %u copied "
+           "(%"PRIu64" bytes), side data reused %u times\n",
+           fctx->nb_pkt_refs, fctx->nb_pkt_copies, fctx->pkt_bytes_copied,
+           fctx->nb_side_data_reused);
+
+    av_buffer_pool_uninit(&fctx->pkt_pool);
     av_freep(&fctx->threads);
     pthread_mutex_destroy(&fctx->buffer_mutex);
     av_freep(&avctx->internal->thread_ctx);
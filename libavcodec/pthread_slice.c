@@ -192,6 +192,13 @@ int ff_slice_thread_init(AVCodecContext *avctx)
         avctx->height > 2800)
         thread_count = avctx->thread_count = 1;
 
+    // Opus only slices over the substreams of a multistream packet
+    if (!av_codec_is_encoder(avctx->codec) &&
+        avctx->codec_id == AV_CODEC_ID_OPUS &&
+        (avctx->extradata_size < 21 || !avctx->extradata[18] ||
+         avctx->extradata[19] <= 1))
+        thread_count = avctx->thread_count = 1;
+
     if (!thread_count) {
         int nb_cpus = av_cpu_count();
         if  (avctx->height)
@@ -43,7 +43,8 @@ void ff_write_pass1_stats(MpegEncContext *s)
 {
     snprintf(s->avctx->stats_out, 256,
              "in:%d out:%d type:%d q:%d itex:%d ptex:%d mv:%d misc:%d "
-             "fcode:%d bcode:%d mc-var:%"PRId64" var:%"PRId64" icount:%d skipcount:%d hbits:%d;\n",
+             "fcode:%d bcode:%d mc-var:%"PRId64" var:%"PRId64" icount:%d skipcount:%d hbits:%d "
+             "mbs:%dx%d;\n",
              s->current_picture_ptr->f->display_picture_number,
              s->current_picture_ptr->f->coded_picture_number,
              s->pict_type,
@@ -57,7 +58,8 @@ void ff_write_pass1_stats(MpegEncContext *s)
              s->current_picture.mc_mb_var_sum,
              s->current_picture.mb_var_sum,
              s->i_count, s->skip_count,
-             s->header_bits);
+             s->header_bits,
+             s->mb_width, s->mb_height);
 }
 
 static double get_fps(AVCodecContext *avctx)
@@ -198,6 +200,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         for (i = 0; i < rcc->num_entries - s->max_b_frames; i++) {
             RateControlEntry *rce;
             int picture_number;
+            int mb_width, mb_height;
             int e;
             char *next;
 
@@ -212,18 +215,28 @@ FF_ENABLE_DEPRECATION_WARNINGS
             av_assert0(picture_number < rcc->num_entries);
             rce = &rcc->entry[picture_number];
 
-            e += sscanf(p, " in:%*d out:%*d type:%d q:%f itex:%d ptex:%d mv:%d misc:%d fcode:%d bcode:%d mc-var:%"SCNd64" var:%"SCNd64" icount:%d skipcount:%d hbits:%d",
+            e += sscanf(p, " in:%*d out:%*d type:%d q:%f itex:%d ptex:%d mv:%d misc:%d fcode:%d bcode:%d mc-var:%"SCNd64" var:%"SCNd64" icount:%d skipcount:%d hbits:%d mbs:%dx%d",
                         &rce->pict_type, &rce->qscale, &rce->i_tex_bits, &rce->p_tex_bits,
                         &rce->mv_bits, &rce->misc_bits,
                         &rce->f_code, &rce->b_code,
                         &rce->mc_mb_var_sum, &rce->mb_var_sum,
-                        &rce->i_count, &rce->skip_count, &rce->header_bits);
-            if (e != 14) {
+                        &rce->i_count, &rce->skip_count, &rce->header_bits,
+                        &mb_width, &mb_height);
+            /* the macroblock dimensions are missing in older files */
+            if (e != 14 && e != 16) {
                 av_log(s->avctx, AV_LOG_ERROR,
                        "statistics are damaged at line %d, parser out=%d\n",
                        i, e);
                 return -1;
             }
+            /* the bits and complexity of a frame do not scale reliably
+             * with its size, so stats of another resolution are useless */
+            if (e == 16 && (mb_width != s->mb_width || mb_height != s->mb_height)) {
+                av_log(s->avctx, AV_LOG_ERROR,
+                       "statistics are for %dx%d macroblocks, not %dx%d\n",
+                       mb_width, mb_height, s->mb_width, s->mb_height);
+                return -1;
+            }
 
             p = next;
         }
@@ -622,6 +635,118 @@ static void update_predictor(Predictor *p, double q, double var, double size)
     p->coeff += new_coeff;
 }
 
+/**
+ * Adjust q so that the frames waiting in the lookahead queue still fit
+ * into the VBV buffer after the current one.
+ * The sizes of the upcoming frames are predicted from their pre-analysis
+ * complexity with the same predictors that the 1-pass code uses for the
+ * current frame. Frames whose type has not been decided yet are assumed
+ * to be P-frames unless the lookahead flagged a scene change.
+ */
+static double lookahead_vbv_qscale(MpegEncContext *s, double q, int64_t var,
+                                   int dry_run)
+{
+    RateControlContext *rcc  = &s->rc_context;
+    const double buffer_size = s->avctx->rc_buffer_size;
+    const double fps         = get_fps(s->avctx);
+    const double min_rate    = s->avctx->rc_min_rate / fps;
+    const double max_rate    = s->avctx->rc_max_rate / fps;
+    const double low_mark    = buffer_size * 0.1;
+    double type_q[5] = { 0 };
+    int64_t frame_var[2 * MAX_B_FRAMES + 2];
+    int frame_type[2 * MAX_B_FRAMES + 2];
+    int nb_frames = 0;
+    Picture *cur = s->reordered_input_picture[0];
+    int i, j, iter, dir = 0;
+
+    if (!max_rate)
+        return q;
+
+    /* The pre-analysis does not search motion, so calibrate it against
+     * what the motion estimation found for the current picture. */
+    if (!dry_run && cur) {
+        int64_t la_var = s->pict_type == AV_PICTURE_TYPE_I ? cur->la_mb_var_sum
+                                                            : cur->la_mc_mb_var_sum;
+        if (la_var > 0) {
+            double ratio = (double)var / la_var;
+            double *r    = &rcc->la_var_ratio[s->pict_type];
+            *r = *r ? 0.8 * *r + 0.2 * ratio : ratio;
+        }
+    }
+
+    /* upcoming frames in coding order: the already reordered ones first,
+     * then the ones still waiting for the B-frame decision */
+    for (i = 1; i < MAX_PICTURE_COUNT && s->reordered_input_picture[i] &&
+                nb_frames < FF_ARRAY_ELEMS(frame_var); i++) {
+        Picture *pic = s->reordered_input_picture[i];
+
+        frame_type[nb_frames] = pic->f->pict_type;
+        frame_var[nb_frames++] = pic->f->pict_type == AV_PICTURE_TYPE_I ?
+                                 pic->la_mb_var_sum : pic->la_mc_mb_var_sum;
+    }
+    for (i = 0; i < MAX_PICTURE_COUNT && s->input_picture[i] &&
+                nb_frames < FF_ARRAY_ELEMS(frame_var); i++) {
+        Picture *pic = s->input_picture[i];
+        int intra;
+
+        for (j = 0; j < MAX_PICTURE_COUNT && s->reordered_input_picture[j]; j++)
+            if (s->reordered_input_picture[j] == pic)
+                break;
+        if (j < MAX_PICTURE_COUNT && s->reordered_input_picture[j])
+            continue;
+
+        intra = pic->la_scenecut || pic->f->pict_type == AV_PICTURE_TYPE_I;
+        frame_type[nb_frames] = intra ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
+        frame_var[nb_frames++] = intra ? pic->la_mb_var_sum : pic->la_mc_mb_var_sum;
+    }
+    if (!nb_frames)
+        return q;
+
+    for (i = 0; i < nb_frames; i++)
+        if (rcc->la_var_ratio[frame_type[i]])
+            frame_var[i] *= rcc->la_var_ratio[frame_type[i]];
+
+    /* keep the usual ratio between the frame types */
+    for (i = 0; i < 5; i++)
+        type_q[i] = rcc->last_qscale_for[i] && rcc->last_qscale_for[s->pict_type] ?
+                    rcc->last_qscale_for[i] / rcc->last_qscale_for[s->pict_type] : 1.0;
+
+    for (iter = 0; iter < 32; iter++) {
+        double buffer = rcc->buffer_index;
+        int underflow = 0, overflow = !!min_rate;
+
+        for (i = -1; i < nb_frames; i++) {
+            double bits = i < 0 ?
+                predict_size(&rcc->pred[s->pict_type], q, sqrt(var)) :
+                predict_size(&rcc->pred[frame_type[i]],
+                             q * type_q[frame_type[i]], sqrt(frame_var[i]));
+            buffer -= bits;
+            if (buffer < low_mark) {
+                underflow = 1;
+                break;
+            }
+            buffer += av_clipd(buffer_size - buffer, min_rate, max_rate);
+            if (buffer <= buffer_size)
+                overflow = 0;
+        }
+
+        if (underflow && dir >= 0) {
+            q  *= 1.05;
+            dir = 1;
+        } else if (overflow && !underflow && dir <= 0) {
+            q  /= 1.05;
+            dir = -1;
+        } else
+            break;
+    }
+
+    if (iter && s->avctx->debug & FF_DEBUG_RC)
+        av_log(s->avctx, AV_LOG_DEBUG,
+               "lookahead of %d frames adjusted q to %f\n", nb_frames, q);
+
+    return q;
+}
+
 static void adaptive_quantization(MpegEncContext *s, double q)
 {
     int i;
@@ -882,6 +1007,9 @@ float ff_rate_estimate_qscale(MpegEncContext *s, int dry_run)
 
         q = modify_qscale(s, rce, q, picture_number);
 
+        if (s->rc_lookahead && a->rc_buffer_size)
+            q = lookahead_vbv_qscale(s, q, var, dry_run);
+
         rcc->pass1_wanted_bits += s->bit_rate / fps;
 
         av_assert0(q > 0.0);
@@ -320,6 +320,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
 
         s->m.mb_type = s->mb_type;
+        s->m.mb_decision = s->avctx->mb_decision;
 
         // dummies, to avoid segfaults
         s->m.current_picture.mb_mean   = (uint8_t *)s->dummy;
@@ -788,9 +788,10 @@ FF_ENABLE_DEPRECATION_WARNINGS
             int size;
             uint8_t *packet_sd = av_packet_get_side_data(pkt, sd[i].packet, &size);
             if (packet_sd) {
-                AVFrameSideData *frame_sd = av_frame_new_side_data(frame,
-                                                                   sd[i].frame,
-                                                                   size);
+                AVFrameSideData *frame_sd = av_frame_new_side_data_from_pool(frame,
+                                                                             avctx->internal->side_data_pool,
+                                                                             sd[i].frame,
+                                                                             size);
                 if (!frame_sd)
                     return AVERROR(ENOMEM);
 
@@ -1287,6 +1288,12 @@ int attribute_align_arg avcodec_open2(AVCodecContext *avctx, const AVCodec *code
         goto free_and_end;
     }
 
+    avctx->internal->side_data_pool = av_frame_side_data_pool_alloc();
+    if (!avctx->internal->side_data_pool) {
+        ret = AVERROR(ENOMEM);
+        goto free_and_end;
+    }
+
     avctx->internal->to_free = av_frame_alloc();
     if (!avctx->internal->to_free) {
         ret = AVERROR(ENOMEM);
@@ -1719,6 +1726,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         av_frame_free(&avctx->internal->buffer_frame);
         av_frame_free(&avctx->internal->to_free);
         av_freep(&avctx->internal->pool);
+        av_frame_side_data_pool_free(&avctx->internal->side_data_pool);
     }
     av_freep(&avctx->internal);
     avctx->codec = NULL;
@@ -1766,6 +1774,54 @@ int ff_alloc_packet2(AVCodecContext *avctx, AVPacket *avpkt, int64_t size, int64
     }
 }
 
+static AVBufferRef *packet_pool_alloc(void *opaque, int size)
+{
+    PacketPool *pool = opaque;
+
+    pool->nb_allocs++;
+    return av_buffer_alloc(size);
+}
+
+int ff_alloc_packet_pool(AVCodecContext *avctx, AVPacket *avpkt,
+                         PacketPool *pool, int64_t size)
+{
+    int i;
+
+    if (avpkt->data || size < 0 ||
+        size + AV_INPUT_BUFFER_PADDING_SIZE > 1 << (PACKET_POOL_MIN_BITS + PACKET_POOL_CLASSES - 1))
+        return ff_alloc_packet2(avctx, avpkt, size, 0);
+
+    for (i = 0; 1 << (PACKET_POOL_MIN_BITS + i) < size + AV_INPUT_BUFFER_PADDING_SIZE; i++)
+        ;
+    if (!pool->pools[i]) {
+        pool->pools[i] = av_buffer_pool_init2(1 << (PACKET_POOL_MIN_BITS + i), pool,
+                                              packet_pool_alloc, NULL);
+        if (!pool->pools[i])
+            return AVERROR(ENOMEM);
+    }
+
+    av_init_packet(avpkt);
+    avpkt->buf = av_buffer_pool_get(pool->pools[i]);
+    if (!avpkt->buf) {
+        av_log(avctx, AV_LOG_ERROR, "Failed to allocate packet of size %"PRId64"\n", size);
+        return AVERROR(ENOMEM);
+    }
+    avpkt->data = avpkt->buf->data;
+    avpkt->size = size;
+    memset(avpkt->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    avctx->internal->pooled_packet = 1;
+
+    return 0;
+}
+
+void ff_packet_pool_uninit(PacketPool *pool)
+{
+    int i;
+
+    for (i = 0; i < PACKET_POOL_CLASSES; i++)
+        av_buffer_pool_uninit(&pool->pools[i]);
+}
+
 int ff_alloc_packet(AVPacket *avpkt, int size)
 {
     return ff_alloc_packet2(NULL, avpkt, size, 0);
@@ -1891,6 +1947,7 @@ int attribute_align_arg avcodec_encode_audio2(AVCodecContext *avctx,
 
     av_assert0(avctx->codec->encode2);
 
+    avctx->internal->pooled_packet = 0;
     ret = avctx->codec->encode2(avctx, avpkt, frame, got_packet_ptr);
     if (!ret) {
         if (*got_packet_ptr) {
@@ -1926,7 +1983,7 @@ int attribute_align_arg avcodec_encode_audio2(AVCodecContext *avctx,
     }
 
     if (!ret) {
-        if (needs_realloc && avpkt->data) {
+        if (needs_realloc && avpkt->data && !avctx->internal->pooled_packet) {
             ret = av_buffer_realloc(&avpkt->buf, avpkt->size + AV_INPUT_BUFFER_PADDING_SIZE);
             if (ret >= 0)
                 avpkt->data = avpkt->buf->data;
@@ -1997,6 +2054,7 @@ int attribute_align_arg avcodec_encode_video2(AVCodecContext *avctx,
 
     av_assert0(avctx->codec->encode2);
 
+    avctx->internal->pooled_packet = 0;
     ret = avctx->codec->encode2(avctx, avpkt, frame, got_packet_ptr);
     av_assert0(ret <= 0);
 
@@ -2027,7 +2085,7 @@ int attribute_align_arg avcodec_encode_video2(AVCodecContext *avctx,
         else if (!(avctx->codec->capabilities & AV_CODEC_CAP_DELAY))
             avpkt->pts = avpkt->dts = frame->pts;
 
-        if (needs_realloc && avpkt->data) {
+        if (needs_realloc && avpkt->data && !avctx->internal->pooled_packet) {
             ret = av_buffer_realloc(&avpkt->buf, avpkt->size + AV_INPUT_BUFFER_PADDING_SIZE);
             if (ret >= 0)
                 avpkt->data = avpkt->buf->data;
@@ -2457,7 +2515,8 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
 
         if ((avctx->flags2 & AV_CODEC_FLAG2_SKIP_MANUAL) && *got_frame_ptr) {
-            AVFrameSideData *fside = av_frame_new_side_data(frame, AV_FRAME_DATA_SKIP_SAMPLES, 10);
+            AVFrameSideData *fside = av_frame_new_side_data_from_pool(frame, avctx->internal->side_data_pool,
+                                                                      AV_FRAME_DATA_SKIP_SAMPLES, 10);
             if (fside) {
                 AV_WL32(fside->data, avctx->internal->skip_samples);
                 AV_WL32(fside->data + 4, discard_padding);
@@ -3052,6 +3111,17 @@ av_cold int avcodec_close(AVCodecContext *avctx)
             av_buffer_pool_uninit(&pool->pools[i]);
         av_freep(&avctx->internal->pool);
 
+        if (avctx->internal->side_data_pool) {
+            AVFrameSideDataPoolStats stats;
+            av_frame_side_data_pool_get_stats(avctx->internal->side_data_pool, &stats);
+            if (stats.nb_requests)
+                av_log(avctx, AV_LOG_DEBUG,
+                       "Side data pool: %"PRIu64" buffers requested, %"PRIu64" allocated "
+                       "(%"PRIu64" bytes)\n",
+                       stats.nb_requests, stats.nb_allocs, stats.alloc_size);
+            av_frame_side_data_pool_free(&avctx->internal->side_data_pool);
+        }
+
         if (avctx->hwaccel && avctx->hwaccel->uninit)
             avctx->hwaccel->uninit(avctx);
         av_freep(&avctx->internal->hwaccel_priv_data);
@@ -20,43 +20,54 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
+
 #include "libavutil/attributes.h"
 #include "libavutil/mem.h"
 #include "vc2enc_dwt.h"
 
-/* Since the transforms spit out interleaved coefficients, this function
- * rearranges the coefficients into the more traditional subdivision,
+/* The transforms keep every row split into its low and high halves, so
+ * this only has to separate the even (low) rows from the odd (high) ones,
  * making it easier to encode and perform another level. */
 static av_always_inline void deinterleave(dwtcoef *linell, ptrdiff_t stride,
                                           int width, int height, dwtcoef *synthl)
 {
-    int x, y;
+    int y;
     ptrdiff_t synthw = width << 1;
-    dwtcoef *linehl = linell + width;
     dwtcoef *linelh = linell + height*stride;
-    dwtcoef *linehh = linelh + width;
 
-    /* Deinterleave the coefficients. */
     for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            linell[x] = synthl[(x << 1)];
-            linehl[x] = synthl[(x << 1) + 1];
-            linelh[x] = synthl[(x << 1) + synthw];
-            linehh[x] = synthl[(x << 1) + synthw + 1];
-        }
+        memcpy(linell, synthl,          synthw*sizeof(*synthl));
+        memcpy(linelh, synthl + synthw, synthw*sizeof(*synthl));
         synthl += synthw << 1;
         linell += stride;
         linelh += stride;
-        linehl += stride;
-        linehh += stride;
     }
 }
 
+/* Copies the data to the buffer, with the even and odd coefficients of
+ * every row separated so that all lifting steps work on contiguous data. */
+static av_always_inline void split_rows(VC2TransformContext *t, dwtcoef *data,
+                                        ptrdiff_t stride, int width, int height,
+                                        int shift)
+{
+    int y;
+    dwtcoef *synthl = t->buffer;
+
+    for (y = 0; y < height << 1; y++) {
+        t->split_row(synthl, synthl + width, data, width, shift);
+        synthl += width << 1;
+        data   += stride;
+    }
+}
+
+#define ROW(y) (synth + (y)*synth_width)
+
 static void vc2_subband_dwt_97(VC2TransformContext *t, dwtcoef *data,
                                ptrdiff_t stride, int width, int height)
 {
-    int x, y;
-    dwtcoef *datal = data, *synth = t->buffer, *synthl = synth;
+    int y;
+    dwtcoef *synth = t->buffer, *synthl = synth;
     const ptrdiff_t synth_width  = width  << 1;
     const ptrdiff_t synth_height = height << 1;
 
@@ -64,75 +75,39 @@ static void vc2_subband_dwt_97(VC2TransformContext *t, dwtcoef *data,
      * Shift in one bit that is used for additional precision and copy
      * the data to the buffer.
      */
-    for (y = 0; y < synth_height; y++) {
-        for (x = 0; x < synth_width; x++)
-            synthl[x] = datal[x] << 1;
-        synthl += synth_width;
-        datal += stride;
-    }
+    split_rows(t, data, stride, width, height, 1);
 
     /* Horizontal synthesis. */
-    synthl = synth;
     for (y = 0; y < synth_height; y++) {
+        dwtcoef *l = synthl, *h = synthl + width;
         /* Lifting stage 2. */
-        synthl[1] -= (8*synthl[0] + 9*synthl[2] - synthl[4] + 8) >> 4;
-        for (x = 1; x < width - 2; x++)
-            synthl[2*x + 1] -= (9*synthl[2*x] + 9*synthl[2*x + 2] - synthl[2*x + 4] -
-                                synthl[2 * x - 2] + 8) >> 4;
-        synthl[synth_width - 1] -= (17*synthl[synth_width - 2] -
-                                    synthl[synth_width - 4] + 8) >> 4;
-        synthl[synth_width - 3] -= (8*synthl[synth_width - 2] +
-                                    9*synthl[synth_width - 4] -
-                                    synthl[synth_width - 6] + 8) >> 4;
+        h[0] -= (8*l[0] + 9*l[1] - l[2] + 8) >> 4;
+        t->lift_sub_97(h + 1, l + 1, l + 2, l + 3, l, width - 3);
+        h[width - 1] -= (17*l[width - 1] - l[width - 2] + 8) >> 4;
+        h[width - 2] -= (8*l[width - 1] + 9*l[width - 2] -
+                         l[width - 3] + 8) >> 4;
         /* Lifting stage 1. */
-        synthl[0] += (synthl[1] + synthl[1] + 2) >> 2;
-        for (x = 1; x < width - 1; x++)
-            synthl[2*x] += (synthl[2*x - 1] + synthl[2*x + 1] + 2) >> 2;
-
-        synthl[synth_width - 2] += (synthl[synth_width - 3] +
-                                    synthl[synth_width - 1] + 2) >> 2;
+        l[0] += (h[0] + h[0] + 2) >> 2;
+        t->lift_add_53(l + 1, h, h + 1, width - 1);
         synthl += synth_width;
     }
 
     /* Vertical synthesis: Lifting stage 2. */
-    synthl = synth + synth_width;
-    for (x = 0; x < synth_width; x++)
-        synthl[x] -= (8*synthl[x - synth_width] + 9*synthl[x + synth_width] -
-                      synthl[x + 3 * synth_width] + 8) >> 4;
-
-    synthl = synth + (synth_width << 1);
-    for (y = 1; y < height - 2; y++) {
-        for (x = 0; x < synth_width; x++)
-            synthl[x + synth_width] -= (9*synthl[x] +
-                                        9*synthl[x + 2 * synth_width] -
-                                        synthl[x - 2 * synth_width] -
-                                        synthl[x + 4 * synth_width] + 8) >> 4;
-        synthl += synth_width << 1;
-    }
-
-    synthl = synth + (synth_height - 1) * synth_width;
-    for (x = 0; x < synth_width; x++) {
-        synthl[x] -= (17*synthl[x - synth_width] -
-                      synthl[x - 3*synth_width] + 8) >> 4;
-                      synthl[x - 2*synth_width] -= (9*synthl[x - 3*synth_width] +
-                      8*synthl[x - 1*synth_width] - synthl[x - 5*synth_width] + 8) >> 4;
-    }
+    t->lift_sub_97(ROW(1), ROW(0), ROW(2), ROW(4), ROW(0), synth_width);
+    for (y = 1; y < height - 2; y++)
+        t->lift_sub_97(ROW(2*y + 1), ROW(2*y), ROW(2*y + 2),
+                       ROW(2*y - 2), ROW(2*y + 4), synth_width);
+    t->lift_sub_97(ROW(synth_height - 1), ROW(synth_height - 2),
+                   ROW(synth_height - 2), ROW(synth_height - 4),
+                   ROW(synth_height - 2), synth_width);
+    t->lift_sub_97(ROW(synth_height - 3), ROW(synth_height - 4),
+                   ROW(synth_height - 2), ROW(synth_height - 6),
+                   ROW(synth_height - 2), synth_width);
 
     /* Vertical synthesis: Lifting stage 1. */
-    synthl = synth;
-    for (x = 0; x < synth_width; x++)
-        synthl[x] += (synthl[x + synth_width] + synthl[x + synth_width] + 2) >> 2;
-
-    synthl = synth + (synth_width << 1);
-    for (y = 1; y < height - 1; y++) {
-        for (x = 0; x < synth_width; x++)
-            synthl[x] += (synthl[x - synth_width] + synthl[x + synth_width] + 2) >> 2;
-        synthl += synth_width << 1;
-    }
-
-    synthl = synth + (synth_height - 2) * synth_width;
-    for (x = 0; x < synth_width; x++)
-        synthl[x] += (synthl[x - synth_width] + synthl[x + synth_width] + 2) >> 2;
+    t->lift_add_53(ROW(0), ROW(1), ROW(1), synth_width);
+    for (y = 1; y < height; y++)
+        t->lift_add_53(ROW(2*y), ROW(2*y - 1), ROW(2*y + 1), synth_width);
 
     deinterleave(data, stride, width, height, synth);
 }
@@ -140,8 +115,8 @@ static void vc2_subband_dwt_97(VC2TransformContext *t, dwtcoef *data,
 static void vc2_subband_dwt_53(VC2TransformContext *t, dwtcoef *data,
                                ptrdiff_t stride, int width, int height)
 {
-    int x, y;
-    dwtcoef *synth = t->buffer, *synthl = synth, *datal = data;
+    int y;
+    dwtcoef *synth = t->buffer, *synthl = synth;
     const ptrdiff_t synth_width  = width  << 1;
     const ptrdiff_t synth_height = height << 1;
 
@@ -149,100 +124,66 @@ static void vc2_subband_dwt_53(VC2TransformContext *t, dwtcoef *data,
      * Shift in one bit that is used for additional precision and copy
      * the data to the buffer.
      */
-    for (y = 0; y < synth_height; y++) {
-        for (x = 0; x < synth_width; x++)
-            synthl[x] = datal[x] << 1;
-        synthl += synth_width;
-        datal  += stride;
-    }
+    split_rows(t, data, stride, width, height, 1);
 
     /* Horizontal synthesis. */
-    synthl = synth;
     for (y = 0; y < synth_height; y++) {
+        dwtcoef *l = synthl, *h = synthl + width;
         /* Lifting stage 2. */
-        for (x = 0; x < width - 1; x++)
-            synthl[2 * x + 1] -= (synthl[2 * x] + synthl[2 * x + 2] + 1) >> 1;
-
-        synthl[synth_width - 1] -= (2*synthl[synth_width - 2] + 1) >> 1;
-
+        t->lift_sub_53(h, l, l + 1, width - 1);
+        h[width - 1] -= (2*l[width - 1] + 1) >> 1;
         /* Lifting stage 1. */
-        synthl[0] += (2*synthl[1] + 2) >> 2;
-        for (x = 1; x < width - 1; x++)
-            synthl[2 * x] += (synthl[2 * x - 1] + synthl[2 * x + 1] + 2) >> 2;
-
-        synthl[synth_width - 2] += (synthl[synth_width - 3] + synthl[synth_width - 1] + 2) >> 2;
-
+        l[0] += (2*h[0] + 2) >> 2;
+        t->lift_add_53(l + 1, h, h + 1, width - 1);
         synthl += synth_width;
     }
 
     /* Vertical synthesis: Lifting stage 2. */
-    synthl = synth + synth_width;
-    for (x = 0; x < synth_width; x++)
-        synthl[x] -= (synthl[x - synth_width] + synthl[x + synth_width] + 1) >> 1;
-
-    synthl = synth + (synth_width << 1);
-    for (y = 1; y < height - 1; y++) {
-        for (x = 0; x < synth_width; x++)
-            synthl[x + synth_width] -= (synthl[x] + synthl[x + synth_width * 2] + 1) >> 1;
-        synthl += (synth_width << 1);
-    }
-
-    synthl = synth + (synth_height - 1) * synth_width;
-    for (x = 0; x < synth_width; x++)
-        synthl[x] -= (2*synthl[x - synth_width] + 1) >> 1;
+    for (y = 0; y < height - 1; y++)
+        t->lift_sub_53(ROW(2*y + 1), ROW(2*y), ROW(2*y + 2), synth_width);
+    t->lift_sub_53(ROW(synth_height - 1), ROW(synth_height - 2),
+                   ROW(synth_height - 2), synth_width);
 
     /* Vertical synthesis: Lifting stage 1. */
-    synthl = synth;
-    for (x = 0; x < synth_width; x++)
-        synthl[x] += (2*synthl[synth_width + x] + 2) >> 2;
-
-    synthl = synth + (synth_width << 1);
-    for (y = 1; y < height - 1; y++) {
-        for (x = 0; x < synth_width; x++)
-            synthl[x] += (synthl[x + synth_width] + synthl[x - synth_width] + 2) >> 2;
-        synthl += (synth_width << 1);
-    }
-
-    synthl = synth + (synth_height - 2)*synth_width;
-    for (x = 0; x < synth_width; x++)
-        synthl[x] += (synthl[x - synth_width] + synthl[x + synth_width] + 2) >> 2;
-
+    t->lift_add_53(ROW(0), ROW(1), ROW(1), synth_width);
+    for (y = 1; y < height; y++)
+        t->lift_add_53(ROW(2*y), ROW(2*y - 1), ROW(2*y + 1), synth_width);
 
     deinterleave(data, stride, width, height, synth);
 }
 
+/* The Haar steps are the 5/3 ones with both taps on the same coefficient:
+ * (2*a + 1) >> 1 == a and (2*a + 2) >> 2 == (a + 1) >> 1 */
 static av_always_inline void dwt_haar(VC2TransformContext *t, dwtcoef *data,
                                       ptrdiff_t stride, int width, int height,
                                       const int s)
 {
-    int x, y;
-    dwtcoef *synth = t->buffer, *synthl = synth, *datal = data;
+    int y;
+    dwtcoef *synth = t->buffer, *synthl = synth;
     const ptrdiff_t synth_width  = width  << 1;
     const ptrdiff_t synth_height = height << 1;
 
+    split_rows(t, data, stride, width, height, s);
+
     /* Horizontal synthesis. */
     for (y = 0; y < synth_height; y++) {
-        for (x = 0; x < synth_width; x += 2) {
-            synthl[y*synth_width + x + 1] = (datal[y*stride + x + 1] << s) -
-                                            (datal[y*stride + x] << s);
-            synthl[y*synth_width + x] = (datal[y*stride + x + 0] << s) +
-                                        ((synthl[y*synth_width + x + 1] + 1) >> 1);
-        }
+        dwtcoef *l = synthl, *h = synthl + width;
+        t->lift_sub_53(h, l, l, width);
+        t->lift_add_53(l, h, h, width);
+        synthl += synth_width;
     }
 
     /* Vertical synthesis. */
-    for (x = 0; x < synth_width; x++) {
-        for (y = 0; y < synth_height; y += 2) {
-            synthl[(y + 1)*synth_width + x] = synthl[(y + 1)*synth_width + x] -
-                                              synthl[y*synth_width + x];
-            synthl[y*synth_width + x] = synthl[y*synth_width + x] +
-                                        ((synthl[(y + 1)*synth_width + x] + 1) >> 1);
-        }
+    for (y = 0; y < height; y++) {
+        t->lift_sub_53(ROW(2*y + 1), ROW(2*y), ROW(2*y), synth_width);
+        t->lift_add_53(ROW(2*y), ROW(2*y + 1), ROW(2*y + 1), synth_width);
     }
 
     deinterleave(data, stride, width, height, synth);
 }
 
+#undef ROW
+
 static void vc2_subband_dwt_haar(VC2TransformContext *t, dwtcoef *data,
                                  ptrdiff_t stride, int width, int height)
 {
@@ -255,6 +196,40 @@ static void vc2_subband_dwt_haar_shift(VC2TransformContext *t, dwtcoef *data,
     dwt_haar(t, data, stride, width, height, 1);
 }
 
+static void split_row_c(dwtcoef *low, dwtcoef *high, const dwtcoef *src,
+                        int width, int shift)
+{
+    int x;
+    for (x = 0; x < width; x++) {
+        low[x]  = src[2*x + 0] << shift;
+        high[x] = src[2*x + 1] << shift;
+    }
+}
+
+static void lift_sub_53_c(dwtcoef *dst, const dwtcoef *a, const dwtcoef *b,
+                          int width)
+{
+    int x;
+    for (x = 0; x < width; x++)
+        dst[x] -= (a[x] + b[x] + 1) >> 1;
+}
+
+static void lift_add_53_c(dwtcoef *dst, const dwtcoef *a, const dwtcoef *b,
+                          int width)
+{
+    int x;
+    for (x = 0; x < width; x++)
+        dst[x] += (a[x] + b[x] + 2) >> 2;
+}
+
+static void lift_sub_97_c(dwtcoef *dst, const dwtcoef *a, const dwtcoef *b,
+                          const dwtcoef *c, const dwtcoef *d, int width)
+{
+    int x;
+    for (x = 0; x < width; x++)
+        dst[x] -= (9*(a[x] + b[x]) - c[x] - d[x] + 8) >> 4;
+}
+
 av_cold int ff_vc2enc_init_transforms(VC2TransformContext *s, int p_width, int p_height)
 {
     s->vc2_subband_dwt[VC2_TRANSFORM_9_7]    = vc2_subband_dwt_97;
@@ -262,6 +237,11 @@ av_cold int ff_vc2enc_init_transforms(VC2TransformContext *s, int p_width, int p
     s->vc2_subband_dwt[VC2_TRANSFORM_HAAR]   = vc2_subband_dwt_haar;
     s->vc2_subband_dwt[VC2_TRANSFORM_HAAR_S] = vc2_subband_dwt_haar_shift;
 
+    s->split_row   = split_row_c;
+    s->lift_sub_53 = lift_sub_53_c;
+    s->lift_add_53 = lift_add_53_c;
+    s->lift_sub_97 = lift_sub_97_c;
+
     s->buffer = av_malloc(2*p_width*p_height*sizeof(dwtcoef));
     if (!s->buffer)
         return 1;
@@ -44,6 +44,26 @@ typedef struct VC2TransformContext {
     void (*vc2_subband_dwt[VC2_TRANSFORMS_NB])(struct VC2TransformContext *t,
                                                dwtcoef *data, ptrdiff_t stride,
                                                int width, int height);
+
+    /**
+     * Split a row of 2*width interleaved coefficients into its even (low)
+     * and odd (high) halves, shifting both left by shift.
+     */
+    void (*split_row)(dwtcoef *low, dwtcoef *high, const dwtcoef *src,
+                      int width, int shift);
+    /**
+     * Lifting steps over width coefficients, used for both the horizontal
+     * and the vertical passes. The sources must not alias dst.
+     * lift_sub_53: dst[x] -= (a[x] + b[x] + 1) >> 1
+     * lift_add_53: dst[x] += (a[x] + b[x] + 2) >> 2
+     * lift_sub_97: dst[x] -= (9*(a[x] + b[x]) - c[x] - d[x] + 8) >> 4
+     */
+    void (*lift_sub_53)(dwtcoef *dst, const dwtcoef *a, const dwtcoef *b,
+                        int width);
+    void (*lift_add_53)(dwtcoef *dst, const dwtcoef *a, const dwtcoef *b,
+                        int width);
+    void (*lift_sub_97)(dwtcoef *dst, const dwtcoef *a, const dwtcoef *b,
+                        const dwtcoef *c, const dwtcoef *d, int width);
 } VC2TransformContext;
 
 int  ff_vc2enc_init_transforms(VC2TransformContext *t, int p_width, int p_height);
@@ -41,6 +41,8 @@ typedef struct {
     int hsub, vsub;             ///< chroma subsampling
     int planes;                 ///< number of planes
     int is_rgb;
+    double *xs;                 ///< X values of a line
+    double *line;               ///< evaluated line
 } GEQContext;
 
 enum { Y = 0, U, V, A, G, B, R };
@@ -78,7 +80,8 @@ static inline double getpix(void *priv, double x, double y, int plane)
     const int w = (plane == 1 || plane == 2) ? AV_CEIL_RSHIFT(picref->width,  geq->hsub) : picref->width;
     const int h = (plane == 1 || plane == 2) ? AV_CEIL_RSHIFT(picref->height, geq->vsub) : picref->height;
 
-    if (!src)
+    /* batch evaluation also calls this for branches which are not taken */
+    if (!src || isnan(x) || isnan(y))
         return 0;
 
     xi = x = av_clipf(x, 0, w - 2);
@@ -192,12 +195,22 @@ static int geq_config_props(AVFilterLink *inlink)
 {
     GEQContext *geq = inlink->dst->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+    int i;
 
     av_assert0(desc);
 
     geq->hsub = desc->log2_chroma_w;
     geq->vsub = desc->log2_chroma_h;
     geq->planes = desc->nb_components;
+
+    av_freep(&geq->xs);
+    av_freep(&geq->line);
+    geq->xs   = av_malloc_array(inlink->w, sizeof(*geq->xs));
+    geq->line = av_malloc_array(inlink->w, sizeof(*geq->line));
+    if (!geq->xs || !geq->line)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < inlink->w; i++)
+        geq->xs[i] = i;
     return 0;
 }
 
@@ -211,6 +224,7 @@ static int geq_filter_frame(AVFilterLink *inlink, AVFrame *in)
         [VAR_N] = inlink->frame_count_out,
         [VAR_T] = in->pts == AV_NOPTS_VALUE ? NAN : in->pts * av_q2d(inlink->time_base),
     };
+    const double *lane_values[VAR_VARS_NB] = { [VAR_X] = geq->xs };
 
     geq->picref = in;
     out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
@@ -234,10 +248,9 @@ static int geq_filter_frame(AVFilterLink *inlink, AVFrame *in)
 
         for (y = 0; y < h; y++) {
             values[VAR_Y] = y;
-            for (x = 0; x < w; x++) {
-                values[VAR_X] = x;
-                dst[x] = av_expr_eval(geq->e[plane], values, geq);
-            }
+            av_expr_eval_batch(geq->e[plane], geq->line, w, values, lane_values, geq);
+            for (x = 0; x < w; x++)
+                dst[x] = geq->line[x];
             dst += linesize;
         }
     }
@@ -253,6 +266,8 @@ static av_cold void geq_uninit(AVFilterContext *ctx)
 
     for (i = 0; i < FF_ARRAY_ELEMS(geq->e); i++)
         av_expr_free(geq->e[i]);
+    av_freep(&geq->xs);
+    av_freep(&geq->line);
 }
 
 static const AVFilterPad geq_inputs[] = {
@@ -23,15 +23,161 @@
 #include "avstring.h"
 #include "dict.h"
 #include "internal.h"
+#include "intreadwrite.h"
 #include "mem.h"
 #include "time_internal.h"
 #include "bprint.h"
 
+/* number of entries from which lookups go through the hash index */
+#define INDEX_MIN_COUNT 32
+/* longer keys are not indexed, they can only match equally long keys */
+#define INDEX_MAX_KEY   256
+
+#define SLOT_EMPTY   -1
+#define SLOT_DELETED -2
+
+typedef struct DictSlot {
+    uint32_t hash;
+    int idx;                    ///< index in elems, or SLOT_EMPTY/SLOT_DELETED
+} DictSlot;
+
 struct AVDictionary {
     int count;
     AVDictionaryEntry *elems;
+
+    /* open addressing hash table over the case folded keys, NULL while the
+     * dictionary is small or if it could not be allocated */
+    DictSlot *index;
+    unsigned index_size;        ///< number of slots, a power of 2
+    unsigned index_used;        ///< slots which are not empty, deleted ones included
 };
 
+static int hash_key(const char *key, uint32_t *hash)
+{
+    uint8_t folded[INDEX_MAX_KEY], digest[16];
+    int len;
+
+    if (!key)
+        return AVERROR(EINVAL);
+    for (len = 0; key[len]; len++) {
+        if (len == INDEX_MAX_KEY)
+            return AVERROR(ERANGE);
+        folded[len] = av_toupper(key[len]);
+    }
+    ff_murmur3_hash(folded, len, digest);
+    *hash = AV_RL32(digest);
+    return 0;
+}
+
+static void index_free(AVDictionary *m)
+{
+    av_freep(&m->index);
+    m->index_size = m->index_used = 0;
+}
+
+static void index_put(DictSlot *index, unsigned size, uint32_t hash, int idx)
+{
+    unsigned i = hash & (size - 1);
+
+    while (index[i].idx >= 0)
+        i = (i + 1) & (size - 1);
+    index[i].hash = hash;
+    index[i].idx  = idx;
+}
+
+static int index_resize(AVDictionary *m, unsigned size)
+{
+    DictSlot *index = av_malloc_array(size, sizeof(*index));
+    unsigned i;
+
+    if (!index)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < size; i++)
+        index[i].idx = SLOT_EMPTY;
+
+    m->index_used = 0;
+    if (m->index) {
+        for (i = 0; i < m->index_size; i++) {
+            if (m->index[i].idx >= 0) {
+                index_put(index, size, m->index[i].hash, m->index[i].idx);
+                m->index_used++;
+            }
+        }
+    } else {
+        for (i = 0; i < m->count; i++) {
+            uint32_t hash;
+            if (hash_key(m->elems[i].key, &hash) >= 0) {
+                index_put(index, size, hash, i);
+                m->index_used++;
+            }
+        }
+    }
+    av_free(m->index);
+    m->index      = index;
+    m->index_size = size;
+    return 0;
+}
+
+/* Find the slot holding the element idx, or NULL if the element is not indexed. */
+static DictSlot *index_find(const AVDictionary *m, int idx)
+{
+    uint32_t hash;
+    unsigned i;
+
+    if (hash_key(m->elems[idx].key, &hash) < 0)
+        return NULL;
+    for (i = hash & (m->index_size - 1); m->index[i].idx != SLOT_EMPTY;
+         i = (i + 1) & (m->index_size - 1))
+        if (m->index[i].idx == idx)
+            return &m->index[i];
+    return NULL;
+}
+
+/* Index the element idx, building or growing the table as needed. On
+ * allocation failure the index is dropped and lookups fall back to scanning. */
+static void index_add(AVDictionary *m, int idx)
+{
+    uint32_t hash;
+
+    if (!m->index) {
+        if (m->count >= INDEX_MIN_COUNT &&
+            index_resize(m, 1 << av_log2(4 * m->count - 1) + 1) < 0)
+            index_free(m);
+        return;
+    }
+    if (4 * (m->index_used + 1) > 3 * m->index_size &&
+        index_resize(m, 4 * m->count > m->index_size ? 2 * m->index_size
+                                                     : m->index_size) < 0) {
+        index_free(m);
+        return;
+    }
+    if (hash_key(m->elems[idx].key, &hash) < 0)
+        return;
+    index_put(m->index, m->index_size, hash, idx);
+    m->index_used++;
+}
+
+static AVDictionaryEntry *index_get(const AVDictionary *m, const char *key,
+                                    uint32_t hash, int flags)
+{
+    AVDictionaryEntry *best = NULL;
+    unsigned i;
+
+    /* equal keys are not merged with AV_DICT_MULTIKEY or when they only
+     * differ in case, the first one in iteration order is the result */
+    for (i = hash & (m->index_size - 1); m->index[i].idx != SLOT_EMPTY;
+         i = (i + 1) & (m->index_size - 1)) {
+        AVDictionaryEntry *e;
+        if (m->index[i].idx < 0 || m->index[i].hash != hash)
+            continue;
+        e = &m->elems[m->index[i].idx];
+        if ((!best || e < best) &&
+            !((flags & AV_DICT_MATCH_CASE) ? strcmp(e->key, key) : av_strcasecmp(e->key, key)))
+            best = e;
+    }
+    return best;
+}
+
 int av_dict_count(const AVDictionary *m)
 {
     return m ? m->count : 0;
@@ -45,6 +191,12 @@ AVDictionaryEntry *av_dict_get(const AVDictionary *m, const char *key,
     if (!m)
         return NULL;
 
+    if (m->index && !prev && !(flags & AV_DICT_IGNORE_SUFFIX)) {
+        uint32_t hash;
+        if (hash_key(key, &hash) >= 0)
+            return index_get(m, key, hash, flags);
+    }
+
     if (prev)
         i = prev - m->elems + 1;
     else
@@ -96,6 +248,14 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value,
             av_free(copy_value);
             return 0;
         }
+        if (m->index) {
+            DictSlot *slot = index_find(m, tag - m->elems);
+            if (slot)
+                slot->idx = SLOT_DELETED;
+            if (tag != &m->elems[m->count - 1] &&
+                (slot = index_find(m, m->count - 1)))
+                slot->idx = tag - m->elems;
+        }
         if (flags & AV_DICT_APPEND)
             oldval = tag->value;
         else
@@ -124,10 +284,12 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value,
             av_freep(&copy_value);
         }
         m->count++;
+        index_add(m, m->count - 1);
     } else {
         av_freep(&copy_key);
     }
     if (!m->count) {
+        index_free(m);
         av_freep(&m->elems);
         av_freep(pm);
     }
@@ -136,6 +298,7 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value,
 
 err_out:
     if (m && !m->count) {
+        index_free(m);
         av_freep(&m->elems);
         av_freep(pm);
     }
@@ -210,6 +373,7 @@ void av_dict_free(AVDictionary **pm)
             av_freep(&m->elems[m->count].value);
         }
         av_freep(&m->elems);
+        index_free(m);
     }
     av_freep(pm);
 }
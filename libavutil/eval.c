@@ -45,6 +45,8 @@ typedef struct Parser {
     int stack_index;
     char *s;
     const double *const_values;
+    const double * const *lane_values;        ///< per-set overrides of const_values, see av_expr_eval_batch()
+    int lane;                                 ///< index of the set in lane_values
     const char * const *const_names;          // NULL terminated
     double (* const *funcs1)(void *, double a);           // NULL terminated
     const char * const *func1_names;          // NULL terminated
@@ -147,6 +149,34 @@ static int strmatch(const char *s, const char *prefix)
     return !IS_IDENTIFIER_CHAR(s[i]);
 }
 
+#define EXPR_BLOCK 64 ///< number of variable sets evaluated together by av_expr_eval_batch()
+#define EXPR_MAX_STACK 16 ///< deeper expressions are evaluated one set at a time
+
+/**
+ * Instruction of the compiled form of an expression. Each instruction is an
+ * AVExpr node whose operands are the results of the previous instructions,
+ * stored in the stack slots following its own destination slot.
+ */
+typedef struct ExprInsn {
+    int type;               ///< AVExpr.type of the node
+    int dst;                ///< stack slot receiving the result
+    int has_param2;
+    double value;
+    union {
+        int const_index;
+        double (*func0)(double);
+        double (*func1)(void *, double);
+        double (*func2)(void *, double, double);
+    } a;
+} ExprInsn;
+
+typedef struct ExprProg {
+    ExprInsn *insns;
+    int nb_insns;
+    int stack_size;         ///< number of stack slots of EXPR_BLOCK values used
+    int sequential;         ///< the expression has state, evaluate one set at a time
+} ExprProg;
+
 struct AVExpr {
     enum {
         e_value, e_const, e_func0, e_func1, e_func2,
@@ -166,6 +196,7 @@ struct AVExpr {
     } a;
     struct AVExpr *param[3];
     double *var;
+    ExprProg *prog; ///< compiled expression, only set on the root node
 };
 
 static double etime(double v)
@@ -177,7 +208,10 @@ static double eval_expr(Parser *p, AVExpr *e)
 {
     switch (e->type) {
         case e_value:  return e->value;
-        case e_const:  return e->value * p->const_values[e->a.const_index];
+        case e_const: {
+            const double *lane = p->lane_values ? p->lane_values[e->a.const_index] : NULL;
+            return e->value * (lane ? lane[p->lane] : p->const_values[e->a.const_index]);
+        }
         case e_func0:  return e->value * e->a.func0(eval_expr(p, e->param[0]));
         case e_func1:  return e->value * e->a.func1(p->opaque, eval_expr(p, e->param[0]));
         case e_func2:  return e->value * e->a.func2(p->opaque, eval_expr(p, e->param[0]), eval_expr(p, e->param[1]));
@@ -323,6 +357,10 @@ void av_expr_free(AVExpr *e)
     av_expr_free(e->param[1]);
     av_expr_free(e->param[2]);
     av_freep(&e->var);
+    if (e->prog) {
+        av_freep(&e->prog->insns);
+        av_freep(&e->prog);
+    }
     av_freep(&e);
 }
 
@@ -656,6 +694,117 @@ static int verify_expr(AVExpr *e)
     }
 }
 
+/**
+ * Replace the subexpressions which do not depend on the constants, the
+ * variables or the user functions by their value.
+ *
+ * @return 1 if e is constant, 0 otherwise
+ */
+static int fold_expr(AVExpr *e)
+{
+    int i, is_const = 1;
+
+    if (!e)
+        return 1;
+    for (i = 0; i < 3; i++)
+        is_const &= fold_expr(e->param[i]);
+
+    switch (e->type) {
+    case e_value:
+        return 1;
+    case e_const:
+    case e_func1:
+    case e_func2:
+    case e_ld:
+    case e_st:
+    case e_random:
+    case e_while:
+    case e_taylor:
+    case e_root:
+    case e_print:
+        return 0;
+    case e_func0:
+        if (e->a.func0 == etime)
+            return 0;
+        break;
+    }
+
+    if (is_const) {
+        Parser p = { 0 };
+
+        e->value = eval_expr(&p, e);
+        e->type  = e_value;
+        for (i = 0; i < 3; i++) {
+            av_expr_free(e->param[i]);
+            e->param[i] = NULL;
+        }
+    }
+    return is_const;
+}
+
+static int expr_size(AVExpr *e, int *sequential)
+{
+    if (!e)
+        return 0;
+    switch (e->type) {
+    case e_ld:
+    case e_st:
+    case e_random:
+    case e_while:
+    case e_taylor:
+    case e_root:
+    case e_print:
+        *sequential = 1;
+    }
+    return 1 + expr_size(e->param[0], sequential)
+             + expr_size(e->param[1], sequential)
+             + expr_size(e->param[2], sequential);
+}
+
+static void compile_expr(ExprProg *prog, AVExpr *e, int sp)
+{
+    ExprInsn *insn;
+    int i;
+
+    for (i = 0; i < 3; i++)
+        if (e->param[i])
+            compile_expr(prog, e->param[i], sp + i);
+
+    insn             = &prog->insns[prog->nb_insns++];
+    insn->type       = e->type;
+    insn->dst        = sp;
+    insn->has_param2 = !!e->param[2];
+    insn->value      = e->value;
+    memcpy(&insn->a, &e->a, sizeof(insn->a));
+    prog->stack_size = FFMAX(prog->stack_size, sp + 1);
+}
+
+static int compile_prog(AVExpr *e)
+{
+    ExprProg *prog = av_mallocz(sizeof(*prog));
+    int nb_insns;
+
+    if (!prog)
+        return AVERROR(ENOMEM);
+    e->prog = prog;
+
+    nb_insns = expr_size(e, &prog->sequential);
+    if (prog->sequential)
+        return 0;
+
+    prog->insns = av_malloc_array(nb_insns, sizeof(*prog->insns));
+    if (!prog->insns)
+        return AVERROR(ENOMEM);
+    compile_expr(prog, e, 0);
+    /* the stack lives on the C stack of av_expr_eval_batch() */
+    if (prog->stack_size > EXPR_MAX_STACK) {
+        av_freep(&prog->insns);
+        prog->nb_insns   = 0;
+        prog->sequential = 1;
+    }
+    return 0;
+}
+
 int av_expr_parse(AVExpr **expr, const char *s,
                   const char * const *const_names,
                   const char * const *func1_names, double (* const *funcs1)(void *, double),
@@ -698,11 +847,14 @@ int av_expr_parse(AVExpr **expr, const char *s,
         ret = AVERROR(EINVAL);
         goto end;
     }
+    fold_expr(e);
     e->var= av_mallocz(sizeof(double) *VARS);
     if (!e->var) {
         ret = AVERROR(ENOMEM);
         goto end;
     }
+    if ((ret = compile_prog(e)) < 0)
+        goto end;
     *expr = e;
     e = NULL;
 end:
@@ -721,6 +873,105 @@ double av_expr_eval(AVExpr *e, const double *const_values, void *opaque)
     return eval_expr(&p, e);
 }
 
+#define LOOP(expr) for (i = 0; i < n; i++) d[i] = expr
+
+static void eval_block(const ExprProg *prog, double *res, int offset, int n,
+                       const double *const_values, const double * const *lane_values,
+                       void *opaque)
+{
+    double stack[EXPR_MAX_STACK * EXPR_BLOCK];
+    int i, j;
+
+    for (j = 0; j < prog->nb_insns; j++) {
+        const ExprInsn *insn = &prog->insns[j];
+        double *d = stack + insn->dst * EXPR_BLOCK;
+        const double *a = d, *b = d + EXPR_BLOCK, *c = d + 2 * EXPR_BLOCK;
+        double v = insn->value;
+
+        switch (insn->type) {
+        case e_value:  LOOP(v); break;
+        case e_const: {
+            const double *lane = lane_values ? lane_values[insn->a.const_index] : NULL;
+            if (lane) {
+                lane += offset;
+                LOOP(v * lane[i]);
+            } else {
+                double k = v * const_values[insn->a.const_index];
+                LOOP(k);
+            }
+            break;
+        }
+        case e_func0:  LOOP(v * insn->a.func0(a[i])); break;
+        case e_func1:  LOOP(v * insn->a.func1(opaque, a[i])); break;
+        case e_func2:  LOOP(v * insn->a.func2(opaque, a[i], b[i])); break;
+        case e_squish: LOOP(1/(1+exp(4*a[i]))); break;
+        case e_gauss:  LOOP(exp(-a[i]*a[i]/2)/sqrt(2*M_PI)); break;
+        case e_isnan:  LOOP(v * !!isnan(a[i])); break;
+        case e_isinf:  LOOP(v * !!isinf(a[i])); break;
+        case e_floor:  LOOP(v * floor(a[i])); break;
+        case e_ceil:   LOOP(v * ceil (a[i])); break;
+        case e_trunc:  LOOP(v * trunc(a[i])); break;
+        case e_sqrt:   LOOP(v * sqrt (a[i])); break;
+        case e_not:    LOOP(v * (a[i] == 0)); break;
+        case e_if:     LOOP(v * ( a[i] ? b[i] : insn->has_param2 ? c[i] : 0)); break;
+        case e_ifnot:  LOOP(v * (!a[i] ? b[i] : insn->has_param2 ? c[i] : 0)); break;
+        case e_clip:
+            LOOP(isnan(b[i]) || isnan(c[i]) || isnan(a[i]) || b[i] > c[i] ? NAN :
+                 v * av_clipd(a[i], b[i], c[i]));
+            break;
+        case e_between: LOOP(v * (a[i] >= b[i] && a[i] <= c[i])); break;
+        case e_mod:    LOOP(v * (a[i] - floor((!CONFIG_FTRAPV || b[i]) ? a[i] / b[i] : a[i] * INFINITY) * b[i])); break;
+        case e_gcd:    LOOP(v * av_gcd(a[i], b[i])); break;
+        case e_max:    LOOP(v * (a[i] >  b[i] ? a[i] : b[i])); break;
+        case e_min:    LOOP(v * (a[i] <  b[i] ? a[i] : b[i])); break;
+        case e_eq:     LOOP(v * (a[i] == b[i] ? 1.0 : 0.0)); break;
+        case e_gt:     LOOP(v * (a[i] >  b[i] ? 1.0 : 0.0)); break;
+        case e_gte:    LOOP(v * (a[i] >= b[i] ? 1.0 : 0.0)); break;
+        case e_lt:     LOOP(v * (a[i] <  b[i] ? 1.0 : 0.0)); break;
+        case e_lte:    LOOP(v * (a[i] <= b[i] ? 1.0 : 0.0)); break;
+        case e_pow:    LOOP(v * pow(a[i], b[i])); break;
+        case e_mul:    LOOP(v * (a[i] * b[i])); break;
+        case e_div:    LOOP(v * ((!CONFIG_FTRAPV || b[i]) ? (a[i] / b[i]) : a[i] * INFINITY)); break;
+        case e_add:    LOOP(v * (a[i] + b[i])); break;
+        case e_last:   LOOP(v * b[i]); break;
+        case e_hypot:  LOOP(v * hypot(a[i], b[i])); break;
+        case e_bitand: LOOP(isnan(a[i]) || isnan(b[i]) ? NAN : v * ((long int)a[i] & (long int)b[i])); break;
+        case e_bitor:  LOOP(isnan(a[i]) || isnan(b[i]) ? NAN : v * ((long int)a[i] | (long int)b[i])); break;
+        default:       LOOP(NAN); break;
+        }
+    }
+    memcpy(res, stack, n * sizeof(*res));
+}
+
+#undef LOOP
+
+void av_expr_eval_batch(AVExpr *e, double *res, int nb,
+                        const double *const_values, const double * const *lane_values,
+                        void *opaque)
+{
+    ExprProg *prog = e->prog;
+    int i, n;
+
+    if (prog->sequential) {
+        Parser p = { 0 };
+
+        p.var          = e->var;
+        p.const_values = const_values;
+        p.lane_values  = lane_values;
+        p.opaque       = opaque;
+        for (i = 0; i < nb; i++) {
+            p.lane = i;
+            res[i] = eval_expr(&p, e);
+        }
+        return;
+    }
+
+    for (i = 0; i < nb; i += n) {
+        n = FFMIN(nb - i, EXPR_BLOCK);
+        eval_block(prog, res + i, i, n, const_values, lane_values, opaque);
+    }
+}
+
 int av_expr_parse_and_eval(double *d, const char *s,
                            const char * const *const_names, const double *const_values,
                            const char * const *func1_names, double (* const *funcs1)(void *, double),
@@ -86,6 +86,34 @@ int av_expr_parse(AVExpr **expr, const char *s,
  */
 double av_expr_eval(AVExpr *e, const double *const_values, void *opaque);
 
+/**
+ * Evaluate a previously parsed expression for several sets of constant
+ * values at once.
+ *
+ * This is equivalent to calling av_expr_eval() nb times, but expressions
+ * without state (st(), ld(), random(), ...) are run as a compiled program on
+ * blocks of sets, which is much faster. The functions from funcs1 and funcs2
+ * may then be called in a different order than with av_expr_eval(), and
+ * are also called for the operands of if(), ifnot() and between() which
+ * av_expr_eval() would skip. They must thus have no side effects and accept
+ * any argument.
+ *
+ * Expressions without state may be evaluated by several threads at once.
+ * Those with state may not, just like with av_expr_eval().
+ *
+ * @param res array where the nb results are stored
+ * @param nb number of sets of constant values
+ * @param const_values a zero terminated array of values for the identifiers
+ *                     from av_expr_parse() const_names, used for all the sets
+ * @param lane_values NULL, or an array with an entry for each identifier from
+ *                    av_expr_parse() const_names, which is either NULL or an
+ *                    array of nb values which override const_values for each set
+ * @param opaque a pointer which will be passed to all functions from funcs1 and funcs2
+ */
+void av_expr_eval_batch(AVExpr *e, double *res, int nb,
+                        const double *const_values, const double * const *lane_values,
+                        void *opaque);
+
 /**
  * Free a parsed expression previously created with av_expr_parse().
  */
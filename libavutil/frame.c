@@ -16,6 +16,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
+
 #include "channel_layout.h"
 #include "avassert.h"
 #include "buffer.h"
@@ -356,7 +358,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
                     return AVERROR(ENOMEM);
                 }
                 sd_dst->data = sd_dst->buf->data;
-                sd_dst->size = sd_dst->buf->size;
+                sd_dst->size = sd_src->size;
             }
         }
         av_dict_copy(&sd_dst->metadata, sd_src->metadata, 0);
@@ -624,9 +626,9 @@ AVBufferRef *av_frame_get_plane_buffer(AVFrame *frame, int plane)
     return NULL;
 }
 
-AVFrameSideData *av_frame_new_side_data(AVFrame *frame,
-                                        enum AVFrameSideDataType type,
-                                        int size)
+static AVFrameSideData *frame_new_side_data(AVFrame *frame,
+                                            enum AVFrameSideDataType type,
+                                            AVBufferRef *buf, int size)
 {
     AVFrameSideData *ret, **tmp;
 
@@ -643,23 +645,135 @@ AVFrameSideData *av_frame_new_side_data(AVFrame *frame,
     if (!ret)
         return NULL;
 
+    if (buf) {
+        ret->buf  = buf;
+        ret->data = buf->data;
+        ret->size = size;
+    }
+    ret->type = type;
+
+    frame->side_data[frame->nb_side_data++] = ret;
+
+    return ret;
+}
+
+AVFrameSideData *av_frame_new_side_data(AVFrame *frame,
+                                        enum AVFrameSideDataType type,
+                                        int size)
+{
+    AVFrameSideData *ret;
+    AVBufferRef *buf = NULL;
+
     if (size > 0) {
-        ret->buf = av_buffer_alloc(size);
-        if (!ret->buf) {
-            av_freep(&ret);
+        buf = av_buffer_alloc(size);
+        if (!buf)
+            return NULL;
+    }
+
+    ret = frame_new_side_data(frame, type, buf, size);
+    if (!ret)
+        av_buffer_unref(&buf);
+
+    return ret;
+}
+
+/* buffers from 64 bytes to 128 KiB are pooled, in power of 2 sizes */
+#define SD_POOL_MIN_SIZE_LOG2  6
+#define SD_POOL_NB_SIZES      12
+
+struct AVFrameSideDataPool {
+    AVBufferPool *pools[SD_POOL_NB_SIZES];
+    atomic_uint_least64_t nb_requests;
+    atomic_uint_least64_t nb_allocs;
+    atomic_uint_least64_t alloc_size;
+};
+
+static AVBufferRef *side_data_pool_alloc(void *opaque, int size)
+{
+    AVFrameSideDataPool *pool = opaque;
+    AVBufferRef *buf = av_buffer_alloc(size);
+
+    if (buf) {
+        atomic_fetch_add_explicit(&pool->nb_allocs,  1,    memory_order_relaxed);
+        atomic_fetch_add_explicit(&pool->alloc_size, size, memory_order_relaxed);
+    }
+    return buf;
+}
+
+AVFrameSideDataPool *av_frame_side_data_pool_alloc(void)
+{
+    AVFrameSideDataPool *pool = av_mallocz(sizeof(*pool));
+    int i;
+
+    if (!pool)
+        return NULL;
+
+    atomic_init(&pool->nb_requests, 0);
+    atomic_init(&pool->nb_allocs,   0);
+    atomic_init(&pool->alloc_size,  0);
+
+    for (i = 0; i < SD_POOL_NB_SIZES; i++) {
+        pool->pools[i] = av_buffer_pool_init2(1 << (SD_POOL_MIN_SIZE_LOG2 + i),
+                                              pool, side_data_pool_alloc, NULL);
+        if (!pool->pools[i]) {
+            av_frame_side_data_pool_free(&pool);
             return NULL;
         }
+    }
 
-        ret->data = ret->buf->data;
-        ret->size = size;
+    return pool;
+}
+
+void av_frame_side_data_pool_free(AVFrameSideDataPool **ppool)
+{
+    AVFrameSideDataPool *pool = *ppool;
+    int i;
+
+    if (!pool)
+        return;
+
+    /* the buffer pools are freed when their last buffer is returned */
+    for (i = 0; i < SD_POOL_NB_SIZES; i++)
+        av_buffer_pool_uninit(&pool->pools[i]);
+    av_freep(ppool);
+}
+
+AVFrameSideData *av_frame_new_side_data_from_pool(AVFrame *frame,
+                                                  AVFrameSideDataPool *pool,
+                                                  enum AVFrameSideDataType type,
+                                                  int size)
+{
+    AVFrameSideData *ret;
+    AVBufferRef *buf = NULL;
+
+    if (size > 0) {
+        int idx = FFMAX(av_log2(size - 1) + 1 - SD_POOL_MIN_SIZE_LOG2, 0);
+
+        atomic_fetch_add_explicit(&pool->nb_requests, 1, memory_order_relaxed);
+
+        if (idx < SD_POOL_NB_SIZES)
+            buf = av_buffer_pool_get(pool->pools[idx]);
+        else
+            buf = side_data_pool_alloc(pool, size);
+        if (!buf)
+            return NULL;
     }
-    ret->type = type;
 
-    frame->side_data[frame->nb_side_data++] = ret;
+    ret = frame_new_side_data(frame, type, buf, size);
+    if (!ret)
+        av_buffer_unref(&buf);
 
     return ret;
 }
 
+void av_frame_side_data_pool_get_stats(AVFrameSideDataPool *pool,
+                                       AVFrameSideDataPoolStats *stats)
+{
+    stats->nb_requests = atomic_load_explicit(&pool->nb_requests, memory_order_relaxed);
+    stats->nb_allocs   = atomic_load_explicit(&pool->nb_allocs,   memory_order_relaxed);
+    stats->alloc_size  = atomic_load_explicit(&pool->alloc_size,  memory_order_relaxed);
+}
+
 AVFrameSideData *av_frame_get_side_data(const AVFrame *frame,
                                         enum AVFrameSideDataType type)
 {
@@ -736,6 +736,76 @@ AVFrameSideData *av_frame_new_side_data(AVFrame *frame,
                                         enum AVFrameSideDataType type,
                                         int size);
 
+/**
+ * A pool of side data buffers, which are recycled when the side data using
+ * them is freed, e.g. by av_frame_unref(). Using a pool for the side data
+ * attached to every frame avoids most of the small memory allocations
+ * otherwise done by av_frame_new_side_data().
+ *
+ * Only the side data payloads come from the pool. The AVFrameSideData
+ * structs and the frame and side data metadata dictionaries are still
+ * allocated with av_malloc().
+ *
+ * The pool is thread-safe. It can be freed while frames still use side data
+ * allocated from it, the memory is then released with the last of them.
+ */
+typedef struct AVFrameSideDataPool AVFrameSideDataPool;
+
+/**
+ * Allocation counters of an AVFrameSideDataPool.
+ * New fields can be added to the end with minor version bumps.
+ */
+typedef struct AVFrameSideDataPoolStats {
+    /**
+     * Number of side data buffers requested from the pool.
+     */
+    uint64_t nb_requests;
+    /**
+     * Number of buffers for which memory was allocated, i.e. which were not
+     * recycled.
+     */
+    uint64_t nb_allocs;
+    /**
+     * Total size in bytes of the memory allocated for the buffers.
+     */
+    uint64_t alloc_size;
+} AVFrameSideDataPoolStats;
+
+/**
+ * Allocate a side data pool.
+ *
+ * @return the pool, or NULL on allocation failure
+ */
+AVFrameSideDataPool *av_frame_side_data_pool_alloc(void);
+
+/**
+ * Free a side data pool and set *pool to NULL.
+ */
+void av_frame_side_data_pool_free(AVFrameSideDataPool **pool);
+
+/**
+ * Add a new side data to a frame, with its buffer taken from a pool.
+ * The returned side data behaves like the one returned by
+ * av_frame_new_side_data(), except that its data is not initialized.
+ *
+ * @param frame a frame to which the side data should be added
+ * @param pool the pool to take the side data buffer from
+ * @param type type of the added side data
+ * @param size size of the side data
+ *
+ * @return newly added side data on success, NULL on error
+ */
+AVFrameSideData *av_frame_new_side_data_from_pool(AVFrame *frame,
+                                                  AVFrameSideDataPool *pool,
+                                                  enum AVFrameSideDataType type,
+                                                  int size);
+
+/**
+ * Get the allocation counters of a side data pool.
+ */
+void av_frame_side_data_pool_get_stats(AVFrameSideDataPool *pool,
+                                       AVFrameSideDataPoolStats *stats);
+
 /**
  * @return a pointer to the side data of a given type on success, NULL if there
  * is no side data with such type in this frame.
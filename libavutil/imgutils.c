@@ -311,6 +311,12 @@ void av_image_copy_plane(uint8_t       *dst, int dst_linesize,
         return;
     av_assert0(abs(src_linesize) >= bytewidth);
     av_assert0(abs(dst_linesize) >= bytewidth);
+    if (height <= 0)
+        return;
+    if (dst_linesize == bytewidth && src_linesize == bytewidth) {
+        memcpy(dst, src, (size_t)bytewidth * height);
+        return;
+    }
     for (;height > 0; height--) {
         memcpy(dst, src, bytewidth);
         dst += dst_linesize;
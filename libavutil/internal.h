@@ -330,6 +330,11 @@ static av_always_inline av_const int avpriv_mirror(int x, int w)
 
 void ff_check_pixfmt_descriptors(void);
 
+/**
+ * Compute the MurMur3 hash of a buffer without allocating a context.
+ */
+void ff_murmur3_hash(const uint8_t *src, int len, uint8_t dst[16]);
+
 /**
  * Set a dictionary value to an ISO-8601 compliant timestamp string.
  *
@@ -21,6 +21,7 @@
 #include "mem.h"
 #include "intreadwrite.h"
 #include "murmur3.h"
+#include "internal.h"
 
 typedef struct AVMurMur3 {
     uint64_t h1, h2;
@@ -153,3 +154,12 @@ void av_murmur3_final(AVMurMur3 *c, uint8_t dst[16])
     AV_WL64(dst, h1);
     AV_WL64(dst + 8, h2);
 }
+
+void ff_murmur3_hash(const uint8_t *src, int len, uint8_t dst[16])
+{
+    AVMurMur3 c;
+
+    av_murmur3_init(&c);
+    av_murmur3_update(&c, src, len);
+    av_murmur3_final(&c, dst);
+}
@@ -19,6 +19,8 @@
  */
 
 #include "libavutil/dict.c"
+#include "libavutil/lfg.h"
+#include "libavutil/time.h"
 
 static void print_dict(const AVDictionary *m)
 {
@@ -46,12 +48,100 @@ static void test_separators(const AVDictionary *m, const char pair, const char v
     av_dict_free(&dict);
 }
 
-int main(void)
+static AVDictionaryEntry *get_linear(AVDictionary *m, const char *key, int flags)
+{
+    DictSlot *index = m ? m->index : NULL;
+    AVDictionaryEntry *e;
+
+    if (m)
+        m->index = NULL;
+    e = av_dict_get(m, key, NULL, flags);
+    if (m)
+        m->index = index;
+    return e;
+}
+
+static int test_index(void)
+{
+    static const int set_flags[] = {
+        0, AV_DICT_MATCH_CASE, AV_DICT_MULTIKEY, AV_DICT_DONT_OVERWRITE,
+        AV_DICT_APPEND, AV_DICT_MATCH_CASE | AV_DICT_MULTIKEY,
+    };
+    AVDictionary *dict = NULL;
+    char key[16], val[16];
+    int i, j, errors = 0;
+    AVLFG lfg;
+
+    av_lfg_init(&lfg, 1);
+    for (i = 0; i < 20000; i++) {
+        int flags = set_flags[av_lfg_get(&lfg) % FF_ARRAY_ELEMS(set_flags)];
+        unsigned r = av_lfg_get(&lfg);
+
+        snprintf(key, sizeof(key), r & 1 ? "KEY%u" : "key%u", (r >> 1) % 3000);
+        snprintf(val, sizeof(val), "%d", i);
+        av_dict_set(&dict, key, r % 7 ? val : NULL, flags);
+
+        for (j = 0; j < 4; j++) {
+            int get_flags = j & 1 ? AV_DICT_MATCH_CASE : 0;
+            r = av_lfg_get(&lfg);
+            snprintf(key, sizeof(key), r & 1 ? "KEY%u" : "key%u", (r >> 1) % 3000);
+            errors += av_dict_get(dict, key, NULL, get_flags) != get_linear(dict, key, get_flags);
+        }
+    }
+    printf("%d entries, %s index, %d mismatches\n",
+           av_dict_count(dict), dict->index ? "with" : "without", errors);
+    av_dict_free(&dict);
+    return errors;
+}
+
+static void bench_index(int nb_entries)
+{
+    AVDictionary *dict = NULL;
+    char key[32];
+    int64_t t[3];
+    int i;
+
+    t[0] = av_gettime_relative();
+    for (i = 0; i < nb_entries; i++) {
+        snprintf(key, sizeof(key), "com.apple.quicktime.%d", i);
+        av_dict_set(&dict, key, "value", 0);
+    }
+    t[0] = av_gettime_relative() - t[0];
+
+    t[1] = av_gettime_relative();
+    for (i = 0; i < nb_entries; i++) {
+        snprintf(key, sizeof(key), "COM.APPLE.QUICKTIME.%d", i);
+        av_dict_get(dict, key, NULL, 0);
+    }
+    t[1] = av_gettime_relative() - t[1];
+
+    index_free(dict);
+    t[2] = av_gettime_relative();
+    for (i = 0; i < nb_entries; i++) {
+        snprintf(key, sizeof(key), "COM.APPLE.QUICKTIME.%d", i);
+        av_dict_get(dict, key, NULL, 0);
+    }
+    t[2] = av_gettime_relative() - t[2];
+
+    printf("%6d entries: set %8.3f us, get %8.3f us, get without index %8.3f us\n",
+           nb_entries, (double)t[0] / nb_entries, (double)t[1] / nb_entries,
+           (double)t[2] / nb_entries);
+    av_dict_free(&dict);
+}
+
+int main(int argc, char **argv)
 {
     AVDictionary *dict = NULL;
     AVDictionaryEntry *e;
     char *buffer = NULL;
 
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        int nb_entries;
+        for (nb_entries = 10; nb_entries <= 10000; nb_entries *= 10)
+            bench_index(nb_entries);
+        return 0;
+    }
+
     printf("Testing av_dict_get_string() and av_dict_parse_string()\n");
     av_dict_get_string(dict, &buffer, '=', ',');
     printf("%s\n", buffer);
@@ -129,5 +219,9 @@ int main(void)
     printf("%s\n", e->value);
     av_dict_free(&dict);
 
+    printf("\nTesting the hash index\n");
+    if (test_index())
+        return 1;
+
     return 0;
 }
@@ -36,6 +36,57 @@ static const char *const const_names[] = {
     0
 };
 
+static const char *const batch_names[] = {
+    "X", "Y", NULL
+};
+
+static double fpix(void *opaque, double x, double y)
+{
+    return fmod(fabs(x * 7 + y * 13), 256);
+}
+
+static const char *const batch_func2_names[] = { "pix", NULL };
+static double (* const batch_funcs2[])(void *, double, double) = { fpix, NULL };
+
+#define BATCH_SIZE 100
+
+static void test_batch(const char *s)
+{
+    AVExpr *e[2] = { NULL };
+    double xs[BATCH_SIZE], res[2][BATCH_SIZE];
+    double values[] = { 0, 3, 0 };
+    const double *lane_values[] = { xs, NULL };
+    int i;
+
+    for (i = 0; i < BATCH_SIZE; i++)
+        xs[i] = (i - 20) * 0.25;
+
+    for (i = 0; i < 2; i++) {
+        if (av_expr_parse(&e[i], s, batch_names, NULL, NULL,
+                          batch_func2_names, batch_funcs2, 0, NULL) < 0) {
+            printf("Parsing '%s' failed\n", s);
+            goto end;
+        }
+    }
+
+    for (i = 0; i < BATCH_SIZE; i++) {
+        values[0] = xs[i];
+        res[0][i] = av_expr_eval(e[0], values, NULL);
+    }
+    av_expr_eval_batch(e[1], res[1], BATCH_SIZE, values, lane_values, NULL);
+
+    for (i = 0; i < BATCH_SIZE; i++) {
+        if (res[0][i] != res[1][i] && !(isnan(res[0][i]) && isnan(res[1][i]))) {
+            printf("Batch '%s' X=%f: %f != %f\n", s, xs[i], res[1][i], res[0][i]);
+            goto end;
+        }
+    }
+    printf("Batch '%s' OK\n", s);
+end:
+    av_expr_free(e[0]);
+    av_expr_free(e[1]);
+}
+
 int main(int argc, char **argv)
 {
     int i;
@@ -139,6 +190,33 @@ int main(int argc, char **argv)
         "clip(0, 0/0, 1)",
         NULL
     };
+    static const char *const batch_exprs[] = {
+        "X+Y",
+        "-X*2^Y",
+        "mod(X, 1.5)",
+        "if(gt(X, 0), X, -X)",
+        "ifnot(X, 5) + if(X, 1)",
+        "clip(X, -1, Y) + clip(X, Y, -1)",
+        "between(X, 0, 2)",
+        "max(X, Y) - min(X, -Y)",
+        "floor(X) + ceil(X) * trunc(-X)",
+        "sqrt(X)",
+        "isnan(sqrt(X)) + isinf(1/X)",
+        "not(X)",
+        "squish(X) - gauss(X)",
+        "hypot(X, Y)",
+        "bitand(X*7, 5) + bitor(X, 8)",
+        "pow(X, Y) / X",
+        "exp(X) + sin(X) * -cos(Y)",
+        "lte(X, 1) + lt(X, 1) + gte(X, 1) + eq(X, 1)",
+        "X; Y; X*Y",
+        "-pix(X, Y*2) + 2*3",
+        "st(0, X + ld(0)); ld(0) * Y",
+        "X * random(0)",
+        /* deeper than the stack of the compiled program */
+        "X+(Y+(X+(Y+(X+(Y+(X+(Y+(X+(Y+(X+(Y+(X+(Y+(X+(Y+(X+Y))))))))))))))))",
+        NULL
+    };
     int ret;
 
     for (expr = exprs; *expr; expr++) {
@@ -167,6 +245,10 @@ int main(int argc, char **argv)
     if (ret < 0)
         printf("av_expr_parse_and_eval failed\n");
 
+    printf("\n");
+    for (expr = batch_exprs; *expr; expr++)
+        test_batch(*expr);
+
     if (argc > 1 && !strcmp(argv[1], "-t")) {
         for (i = 0; i < 1050; i++) {
             START_TIMER;
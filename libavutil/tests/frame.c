@@ -0,0 +1,102 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/frame.h"
+
+static void print_stats(const char *when, AVFrameSideDataPool *pool)
+{
+    AVFrameSideDataPoolStats stats;
+
+    av_frame_side_data_pool_get_stats(pool, &stats);
+    printf("%-28s requests %"PRIu64", allocs %"PRIu64", bytes %"PRIu64"\n",
+           when, stats.nb_requests, stats.nb_allocs, stats.alloc_size);
+}
+
+static AVFrameSideData *new_side_data(AVFrame *frame, AVFrameSideDataPool *pool,
+                                      int size)
+{
+    AVFrameSideData *sd = av_frame_new_side_data_from_pool(frame, pool,
+                                                           AV_FRAME_DATA_A53_CC,
+                                                           size);
+    if (!sd) {
+        printf("Failed to allocate %d bytes of side data\n", size);
+        return NULL;
+    }
+    if (sd->size != size)
+        printf("Side data size %d, expected %d\n", sd->size, size);
+    memset(sd->data, 0x5a, size);
+    return sd;
+}
+
+int main(void)
+{
+    AVFrameSideDataPool *pool = av_frame_side_data_pool_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVFrame *ref   = av_frame_alloc();
+    AVFrameSideData *sd;
+    int i;
+
+    if (!pool || !frame || !ref)
+        return 1;
+
+    /* buffers of the same size class are recycled */
+    for (i = 0; i < 4; i++) {
+        if (!new_side_data(frame, pool, 100 + i))
+            return 1;
+        av_frame_unref(frame);
+    }
+    print_stats("sequential, same class:", pool);
+
+    /* a buffer still in use is not handed out again */
+    if (!new_side_data(frame, pool, 100) ||
+        !new_side_data(frame, pool, 100))
+        return 1;
+    av_frame_unref(frame);
+    print_stats("two in use at once:", pool);
+
+    /* larger buffers are not pooled, but still counted */
+    for (i = 0; i < 2; i++) {
+        if (!new_side_data(frame, pool, 200000))
+            return 1;
+        av_frame_unref(frame);
+    }
+    print_stats("above the largest class:", pool);
+
+    /* references keep the requested size, not the size of the class */
+    if (!new_side_data(frame, pool, 10) || av_frame_copy_props(ref, frame) < 0)
+        return 1;
+    sd = av_frame_get_side_data(ref, AV_FRAME_DATA_A53_CC);
+    printf("size of the referenced side data: %d\n", sd ? sd->size : -1);
+    av_frame_unref(ref);
+    print_stats("after a reference:", pool);
+
+    /* the frame keeps its buffer when the pool is freed first */
+    av_frame_side_data_pool_free(&pool);
+    printf("pool freed: %s\n", pool ? "no" : "yes");
+    sd = av_frame_get_side_data(frame, AV_FRAME_DATA_A53_CC);
+    memset(sd->data, 0xa5, sd->size);
+    av_frame_unref(frame);
+
+    av_frame_free(&frame);
+    av_frame_free(&ref);
+    return 0;
+}
@@ -17,13 +17,137 @@
  */
 
 #include "libavutil/imgutils.c"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
 
 #undef printf
 
-int main(void)
+static void copy_plane_lines(uint8_t       *dst, int dst_linesize,
+                             const uint8_t *src, int src_linesize,
+                             int bytewidth, int height)
+{
+    for (; height > 0; height--) {
+        memcpy(dst, src, bytewidth);
+        dst += dst_linesize;
+        src += src_linesize;
+    }
+}
+
+static int test_copy_plane(void)
+{
+    static const struct {
+        int bytewidth, height, dst_pad, src_pad, flip;
+    } tests[] = {
+        {    1,    1,  0,  0, 0 },
+        {   63,   17,  1, 33, 0 },
+        {   64,   64,  0,  0, 0 },
+        {  100,   33, 28,  5, 1 },
+        { 1920, 1080,  0,  0, 0 },
+        { 3840, 2160, 64,  0, 0 },
+        { 3840, 2160,  0, 13, 1 },
+        { 4109, 1100, 19, 64, 0 },
+    };
+    int i, ret = 0;
+    AVLFG lfg;
+
+    av_lfg_init(&lfg, 1);
+    for (i = 0; i < FF_ARRAY_ELEMS(tests); i++) {
+        int dst_linesize = tests[i].bytewidth + tests[i].dst_pad;
+        int src_linesize = tests[i].bytewidth + tests[i].src_pad;
+        int h = tests[i].height;
+        uint8_t *src  = av_malloc((size_t)src_linesize * h);
+        uint8_t *dst  = av_malloc((size_t)dst_linesize * h);
+        uint8_t *dst2 = av_malloc((size_t)dst_linesize * h);
+        uint8_t *s, *d, *d2;
+        int j, src_stride = src_linesize, dst_stride = dst_linesize;
+
+        if (!src || !dst || !dst2) {
+            ret = AVERROR(ENOMEM);
+        } else {
+            for (j = 0; j < src_linesize * h; j++)
+                src[j] = av_lfg_get(&lfg);
+            memset(dst,  0x55, (size_t)dst_linesize * h);
+            memset(dst2, 0x55, (size_t)dst_linesize * h);
+
+            s = src; d = dst; d2 = dst2;
+            if (tests[i].flip) {
+                s  += (h - 1) * src_linesize;
+                d  += (h - 1) * dst_linesize;
+                d2 += (h - 1) * dst_linesize;
+                src_stride = -src_linesize;
+                dst_stride = -dst_linesize;
+            }
+            av_image_copy_plane(d, dst_stride, s, src_stride, tests[i].bytewidth, h);
+            copy_plane_lines(d2, dst_stride, s, src_stride, tests[i].bytewidth, h);
+            if (memcmp(dst, dst2, (size_t)dst_linesize * h)) {
+                printf("av_image_copy_plane %dx%d failed\n", tests[i].bytewidth, h);
+                ret = 1;
+            }
+        }
+        av_free(src);
+        av_free(dst);
+        av_free(dst2);
+        if (ret)
+            return ret;
+    }
+    printf("av_image_copy_plane OK\n");
+    return 0;
+}
+
+static void bench_copy_plane(void)
+{
+    static const struct {
+        const char *name;
+        int w, h;
+    } sizes[] = {
+        { "720x576",    720,  576 },
+        { "1920x1080", 1920, 1080 },
+        { "3840x2160", 3840, 2160 },
+        { "7680x4320", 7680, 4320 },
+    };
+    int i, j;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(sizes); i++) {
+        int linesize = FFALIGN(sizes[i].w, 64), h = sizes[i].h;
+        int64_t size = (int64_t)sizes[i].w * h, t[2];
+        int runs = FFMAX((1 << 30) / size, 1);
+        uint8_t *src = av_mallocz((size_t)linesize * h);
+        uint8_t *dst = av_mallocz((size_t)linesize * h);
+
+        if (!src || !dst) {
+            av_free(src);
+            av_free(dst);
+            return;
+        }
+
+        t[0] = av_gettime_relative();
+        for (j = 0; j < runs; j++)
+            copy_plane_lines(dst, linesize, src, linesize, sizes[i].w, h);
+        t[0] = av_gettime_relative() - t[0];
+
+        t[1] = av_gettime_relative();
+        for (j = 0; j < runs; j++)
+            av_image_copy_plane(dst, linesize, src, linesize, sizes[i].w, h);
+        t[1] = av_gettime_relative() - t[1];
+
+        printf("%-10s memcpy per line %6.2f GB/s, av_image_copy_plane %6.2f GB/s\n",
+               sizes[i].name, size * runs / (FFMAX(t[0], 1) * 1000.0),
+               size * runs / (FFMAX(t[1], 1) * 1000.0));
+        av_free(src);
+        av_free(dst);
+    }
+}
+
+int main(int argc, char **argv)
 {
     int64_t x, y;
 
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        bench_copy_plane();
+        return 0;
+    }
+
     for (y = -1; y<UINT_MAX; y+= y/2 + 1) {
         for (x = -1; x<UINT_MAX; x+= x/2 + 1) {
             int ret = av_image_check_size(x, y, 0, NULL);
@@ -32,5 +156,5 @@ int main(void)
         printf("\n");
     }
 
-    return 0;
+    return test_copy_plane();
 }
@@ -21,6 +21,7 @@
 #include "swresample_internal.h"
 #include "libavutil/avassert.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/internal.h"
 
 #define TEMPLATE_REMATRIX_FLT
 #include "rematrix_template.c"
@@ -391,7 +392,7 @@ av_cold int swri_rematrix_init(SwrContext *s){
         if (r)
             return r;
     }
-    if (s->midbuf.fmt == AV_SAMPLE_FMT_S16P){
+    if (s->midbuf.fmt == AV_SAMPLE_FMT_S16P || s->midbuf.fmt == AV_SAMPLE_FMT_S32P){
         int maxsum = 0;
         s->native_matrix = av_calloc(nb_in * nb_out, sizeof(int));
         s->native_one    = av_mallocz(sizeof(int));
@@ -410,7 +411,11 @@ av_cold int swri_rematrix_init(SwrContext *s){
             maxsum = FFMAX(maxsum, sum);
         }
         *((int*)s->native_one) = 32768;
-        if (maxsum <= 32768) {
+        if (s->midbuf.fmt == AV_SAMPLE_FMT_S32P) {
+            s->mix_1_1_f = (mix_1_1_func_type*)copy_s32;
+            s->mix_2_1_f = (mix_2_1_func_type*)sum2_s32;
+            s->mix_any_f = (mix_any_func_type*)get_mix_any_func_s32(s);
+        } else if (maxsum <= 32768) {
             s->mix_1_1_f = (mix_1_1_func_type*)copy_s16;
             s->mix_2_1_f = (mix_2_1_func_type*)sum2_s16;
             s->mix_any_f = (mix_any_func_type*)get_mix_any_func_s16(s);
@@ -443,19 +448,6 @@ av_cold int swri_rematrix_init(SwrContext *s){
         s->mix_1_1_f = (mix_1_1_func_type*)copy_double;
         s->mix_2_1_f = (mix_2_1_func_type*)sum2_double;
         s->mix_any_f = (mix_any_func_type*)get_mix_any_func_double(s);
-    }else if(s->midbuf.fmt == AV_SAMPLE_FMT_S32P){
-        // Only for dithering currently
-//         s->native_matrix = av_calloc(nb_in * nb_out, sizeof(double));
-        s->native_one    = av_mallocz(sizeof(int));
-        if (!s->native_one)
-            return AVERROR(ENOMEM);
-//         for (i = 0; i < nb_out; i++)
-//             for (j = 0; j < nb_in; j++)
-//                 ((double*)s->native_matrix)[i * nb_in + j] = s->matrix[i][j];
-        *((int*)s->native_one) = 32768;
-        s->mix_1_1_f = (mix_1_1_func_type*)copy_s32;
-        s->mix_2_1_f = (mix_2_1_func_type*)sum2_s32;
-        s->mix_any_f = (mix_any_func_type*)get_mix_any_func_s32(s);
     }else
         av_assert0(0);
     //FIXME quantize for integeres
@@ -482,25 +474,23 @@ av_cold void swri_rematrix_free(SwrContext *s){
     av_freep(&s->native_simd_one);
 }
 
-int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mustcopy){
+typedef struct RematrixThreadData {
+    AudioData *out, *in;
+    int len, mustcopy;
+} RematrixThreadData;
+
+static void rematrix_channels(SwrContext *s, AudioData *out, AudioData *in, int len, int mustcopy,
+                              int ch_start, int ch_end){
     int out_i, in_i, i, j;
     int len1 = 0;
     int off = 0;
 
-    if(s->mix_any_f) {
-        s->mix_any_f(out->ch, (const uint8_t **)in->ch, s->native_matrix, len);
-        return 0;
-    }
-
     if(s->mix_2_1_simd || s->mix_1_1_simd){
         len1= len&~15;
         off = len1 * out->bps;
     }
 
-    av_assert0(!s->out_ch_layout || out->ch_count == av_get_channel_layout_nb_channels(s->out_ch_layout));
-    av_assert0(!s-> in_ch_layout || in ->ch_count == av_get_channel_layout_nb_channels(s-> in_ch_layout));
-
-    for(out_i=0; out_i<out->ch_count; out_i++){
+    for(out_i=ch_start; out_i<ch_end; out_i++){
         switch(s->matrix_ch[out_i][0]){
         case 0:
             if(mustcopy)
@@ -548,6 +538,15 @@ int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mus
                     }
                     ((double*)out->ch[out_i])[i]= v;
                 }
+            }else if(s->int_sample_fmt == AV_SAMPLE_FMT_S32P){
+                for(i=0; i<len; i++){
+                    int64_t v=0;
+                    for(j=0; j<s->matrix_ch[out_i][0]; j++){
+                        in_i= s->matrix_ch[out_i][1+j];
+                        v+= ((int32_t*)in->ch[in_i])[i] * (int64_t)s->matrix32[out_i][in_i];
+                    }
+                    ((int32_t*)out->ch[out_i])[i]= (v + 16384)>>15;
+                }
             }else{
                 for(i=0; i<len; i++){
                     int v=0;
@@ -555,10 +554,38 @@ int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mus
                         in_i= s->matrix_ch[out_i][1+j];
                         v+= ((int16_t*)in->ch[in_i])[i] * s->matrix32[out_i][in_i];
                     }
-                    ((int16_t*)out->ch[out_i])[i]= (v + 16384)>>15;
+                    ((int16_t*)out->ch[out_i])[i]= av_clip_int16((v + 16384)>>15);
                 }
             }
         }
     }
+}
+
+static int rematrix_job(SwrContext *s, void *arg, int jobnr, int nb_jobs){
+    RematrixThreadData *td = arg;
+    int ch_count = td->out->ch_count;
+
+    rematrix_channels(s, td->out, td->in, td->len, td->mustcopy,
+                      ch_count * jobnr / nb_jobs, ch_count * (jobnr + 1) / nb_jobs);
+    emms_c();
+    return 0;
+}
+
+int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mustcopy){
+    int nb_jobs = FFMIN(s->nb_threads, out->ch_count);
+
+    if(s->mix_any_f) {
+        s->mix_any_f(out->ch, (const uint8_t **)in->ch, s->native_matrix, len);
+        return 0;
+    }
+
+    av_assert0(!s->out_ch_layout || out->ch_count == av_get_channel_layout_nb_channels(s->out_ch_layout));
+    av_assert0(!s-> in_ch_layout || in ->ch_count == av_get_channel_layout_nb_channels(s-> in_ch_layout));
+
+    if(nb_jobs > 1){
+        RematrixThreadData td = { out, in, len, mustcopy };
+        s->execute(s, rematrix_job, &td, nb_jobs);
+    }else
+        rematrix_channels(s, out, in, len, mustcopy, 0, out->ch_count);
     return 0;
 }
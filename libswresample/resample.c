@@ -467,7 +467,30 @@ static int set_compensation(ResampleContext *c, int sample_delta, int compensati
     return 0;
 }
 
-static int multiple_resample(ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed){
+typedef struct ResampleThreadData {
+    int (*resample_func)(struct ResampleContext *c, void *dst,
+                         const void *src, int n, int update_ctx);
+    AudioData *dst, *src;
+    int n;
+} ResampleThreadData;
+
+static int resample_channels(SwrContext *s, void *arg, int jobnr, int nb_jobs)
+{
+    ResampleThreadData *td = arg;
+    int start = td->dst->ch_count *  jobnr      / nb_jobs;
+    int end   = td->dst->ch_count * (jobnr + 1) / nb_jobs;
+    int i;
+
+    for (i = start; i < end; i++)
+        td->resample_func(s->resample, td->dst->ch[i], td->src->ch[i], td->n, 0);
+
+    /* the MMX state is per thread, the caller's emms_c() does not reach it */
+    emms_c();
+    return 0;
+}
+
+static int multiple_resample(SwrContext *s, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed){
+    ResampleContext *c = s->resample;
     int i;
     int av_unused mm_flags = av_get_cpu_flags();
     int need_emms = c->format == AV_SAMPLE_FMT_S16P && ARCH_X86_32 &&
@@ -512,8 +535,21 @@ static int multiple_resample(ResampleContext *c, AudioData *dst, int dst_size, A
              * when frac and dst_incr_mod are zero */
             resample_func = (c->linear && (c->frac || c->dst_incr_mod)) ?
                             c->dsp.resample_linear : c->dsp.resample_common;
-            for (i = 0; i < dst->ch_count; i++)
-                *consumed = resample_func(c, dst->ch[i], src->ch[i], dst_size, i+1 == dst->ch_count);
+            if (FFMIN(s->nb_threads, dst->ch_count) > 1) {
+                ResampleThreadData td = { resample_func, dst, src, dst_size };
+                int64_t frac  = c->frac + dst_size * (int64_t)c->dst_incr_mod;
+                int64_t index = c->index + dst_size * (int64_t)c->dst_incr_div + frac / c->src_incr;
+
+                /* the channels only read the context, so it is advanced
+                 * afterwards the same way the per-sample loop would */
+                s->execute(s, resample_channels, &td, FFMIN(s->nb_threads, dst->ch_count));
+                *consumed = index / c->phase_count;
+                c->index  = index % c->phase_count;
+                c->frac   = frac  % c->src_incr;
+            } else {
+                for (i = 0; i < dst->ch_count; i++)
+                    *consumed = resample_func(c, dst->ch[i], src->ch[i], dst_size, i+1 == dst->ch_count);
+            }
         }
     }
 
@@ -114,6 +114,19 @@ static void free_temp(AudioData *a){
     memset(a, 0, sizeof(*a));
 }
 
+#if !HAVE_THREADS
+int swri_thread_init(SwrContext *s)
+{
+    s->nb_threads = 1;
+    return 0;
+}
+
+void swri_thread_free(SwrContext *s)
+{
+    s->nb_threads = 1;
+}
+#endif
+
 static void clear_context(SwrContext *s){
     s->in_buffer_index= 0;
     s->in_buffer_count= 0;
@@ -132,6 +145,7 @@ static void clear_context(SwrContext *s){
     swri_audio_convert_free(&s->out_convert);
     swri_audio_convert_free(&s->full_convert);
     swri_rematrix_free(s);
+    swri_thread_free(s);
 
     s->delayed_samples_fixup = 0;
     s->flushed = 0;
@@ -383,6 +397,9 @@ av_assert0(s->out.ch_count);
             goto fail;
     }
 
+    if ((ret = swri_thread_init(s)) < 0)
+        goto fail;
+
     return 0;
 fail:
     swr_close(s);
@@ -507,7 +524,7 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
         int ret, size, consumed;
         if(!s->resample_in_constraint && s->in_buffer_count){
             buf_set(&tmp, &s->in_buffer, s->in_buffer_index);
-            ret= s->resampler->multiple_resample(s->resample, &out, out_count, &tmp, s->in_buffer_count, &consumed);
+            ret= s->resampler->multiple_resample(s, &out, out_count, &tmp, s->in_buffer_count, &consumed);
             out_count -= ret;
             ret_sum += ret;
             buf_set(&out, &out, ret);
@@ -527,7 +544,7 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
 
         if((s->flushed || in_count > padless) && !s->in_buffer_count){
             s->in_buffer_index=0;
-            ret= s->resampler->multiple_resample(s->resample, &out, out_count, &in, FFMAX(in_count-padless, 0), &consumed);
+            ret= s->resampler->multiple_resample(s, &out, out_count, &in, FFMAX(in_count-padless, 0), &consumed);
             out_count -= ret;
             ret_sum += ret;
             buf_set(&out, &out, ret);
@@ -572,6 +589,50 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
     return ret_sum;
 }
 
+typedef struct DitherThreadData {
+    AudioData *dst, *src;
+    int count;
+} DitherThreadData;
+
+static void dither_channels(struct SwrContext *s, AudioData *dst, AudioData *src, int count,
+                            int ch_start, int ch_end){
+    int ch;
+
+    if (s->dither.method < SWR_DITHER_NS){
+        if (s->mix_2_1_simd) {
+            int len1= count&~15;
+            int off = len1 * src->bps;
+
+            if(len1)
+                for(ch=ch_start; ch<ch_end; ch++)
+                    s->mix_2_1_simd(dst->ch[ch], src->ch[ch], s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos, s->native_simd_one, 0, 0, len1);
+            if(count != len1)
+                for(ch=ch_start; ch<ch_end; ch++)
+                    s->mix_2_1_f(dst->ch[ch] + off, src->ch[ch] + off, s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos + off + len1, s->native_one, 0, 0, count - len1);
+        } else {
+            for(ch=ch_start; ch<ch_end; ch++)
+                s->mix_2_1_f(dst->ch[ch], src->ch[ch], s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos, s->native_one, 0, 0, count);
+        }
+    } else {
+        switch(s->int_sample_fmt) {
+        case AV_SAMPLE_FMT_S16P :swri_noise_shaping_int16(s, dst, src, &s->dither.noise, count, ch_start, ch_end); break;
+        case AV_SAMPLE_FMT_S32P :swri_noise_shaping_int32(s, dst, src, &s->dither.noise, count, ch_start, ch_end); break;
+        case AV_SAMPLE_FMT_FLTP :swri_noise_shaping_float(s, dst, src, &s->dither.noise, count, ch_start, ch_end); break;
+        case AV_SAMPLE_FMT_DBLP :swri_noise_shaping_double(s,dst, src, &s->dither.noise, count, ch_start, ch_end); break;
+        }
+    }
+}
+
+static int dither_job(struct SwrContext *s, void *arg, int jobnr, int nb_jobs){
+    DitherThreadData *td = arg;
+    int ch_count = td->src->ch_count;
+
+    dither_channels(s, td->dst, td->src, td->count,
+                    ch_count * jobnr / nb_jobs, ch_count * (jobnr + 1) / nb_jobs);
+    emms_c();
+    return 0;
+}
+
 static int swr_convert_internal(struct SwrContext *s, AudioData *out, int out_count,
                                                       AudioData *in , int  in_count){
     AudioData *postin, *midbuf, *preout;
@@ -669,28 +730,14 @@ static int swr_convert_internal(struct SwrContext *s, AudioData *out, int out_co
             if(s->dither.noise_pos + out_count > s->dither.noise.count)
                 s->dither.noise_pos = 0;
 
-            if (s->dither.method < SWR_DITHER_NS){
-                if (s->mix_2_1_simd) {
-                    int len1= out_count&~15;
-                    int off = len1 * preout->bps;
-
-                    if(len1)
-                        for(ch=0; ch<preout->ch_count; ch++)
-                            s->mix_2_1_simd(conv_src->ch[ch], preout->ch[ch], s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos, s->native_simd_one, 0, 0, len1);
-                    if(out_count != len1)
-                        for(ch=0; ch<preout->ch_count; ch++)
-                            s->mix_2_1_f(conv_src->ch[ch] + off, preout->ch[ch] + off, s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos + off + len1, s->native_one, 0, 0, out_count - len1);
-                } else {
-                    for(ch=0; ch<preout->ch_count; ch++)
-                        s->mix_2_1_f(conv_src->ch[ch], preout->ch[ch], s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos, s->native_one, 0, 0, out_count);
-                }
-            } else {
-                switch(s->int_sample_fmt) {
-                case AV_SAMPLE_FMT_S16P :swri_noise_shaping_int16(s, conv_src, preout, &s->dither.noise, out_count); break;
-                case AV_SAMPLE_FMT_S32P :swri_noise_shaping_int32(s, conv_src, preout, &s->dither.noise, out_count); break;
-                case AV_SAMPLE_FMT_FLTP :swri_noise_shaping_float(s, conv_src, preout, &s->dither.noise, out_count); break;
-                case AV_SAMPLE_FMT_DBLP :swri_noise_shaping_double(s,conv_src, preout, &s->dither.noise, out_count); break;
-                }
+            if (FFMIN(s->nb_threads, preout->ch_count) > 1) {
+                DitherThreadData td = { conv_src, preout, out_count };
+                s->execute(s, dither_job, &td, FFMIN(s->nb_threads, preout->ch_count));
+            } else
+                dither_channels(s, conv_src, preout, out_count, 0, preout->ch_count);
+            if (s->dither.method >= SWR_DITHER_NS) {
+                int taps = s->dither.ns_taps;
+                s->dither.ns_pos = ((s->dither.ns_pos - out_count) % taps + taps) % taps;
             }
             s->dither.noise_pos += out_count;
         }
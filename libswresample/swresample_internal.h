@@ -71,7 +71,7 @@ struct DitherContext {
 typedef struct ResampleContext * (* resample_init_func)(struct ResampleContext *c, int out_rate, int in_rate, int filter_size, int phase_shift, int linear,
                                     double cutoff, enum AVSampleFormat format, enum SwrFilterType filter_type, double kaiser_beta, double precision, int cheby, int exact_rational);
 typedef void    (* resample_free_func)(struct ResampleContext **c);
-typedef int     (* multiple_resample_func)(struct ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed);
+typedef int     (* multiple_resample_func)(struct SwrContext *s, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed);
 typedef int     (* resample_flush_func)(struct SwrContext *c);
 typedef int     (* set_compensation_func)(struct ResampleContext *c, int sample_delta, int compensation_distance);
 typedef int64_t (* get_delay_func)(struct SwrContext *s, int64_t base);
@@ -92,6 +92,13 @@ struct Resampler {
 extern struct Resampler const swri_resampler;
 extern struct Resampler const swri_soxr_resampler;
 
+/**
+ * Job run on the worker threads, processing the channels
+ * [ch_count * jobnr / nb_jobs, ch_count * (jobnr + 1) / nb_jobs).
+ */
+typedef int (swri_job_func)(struct SwrContext *s, void *arg, int jobnr, int nb_jobs);
+typedef int (swri_execute_func)(struct SwrContext *s, swri_job_func *func, void *arg, int nb_jobs);
+
 struct SwrContext {
     const AVClass *av_class;                        ///< AVClass used for AVOption and av_log()
     int log_level_offset;                           ///< logging level offset
@@ -121,6 +128,7 @@ struct SwrContext {
     int64_t user_out_ch_layout;                     ///< User set output channel layout
     enum AVSampleFormat user_int_sample_fmt;        ///< User set internal sample format
     int user_dither_method;                         ///< User set dither method
+    int user_nb_threads;                            ///< User set number of threads
 
     struct DitherContext dither;
 
@@ -184,16 +192,20 @@ struct SwrContext {
 
     mix_any_func_type *mix_any_f;
 
+    int nb_threads;                                 ///< number of threads the channels are split across
+    struct SwrThreadContext *thread;                ///< worker threads, NULL if nb_threads is 1
+    swri_execute_func *execute;                     ///< run a job for each channel group on the worker threads
+
     /* TODO: callbacks for ASM optimizations */
 };
 
 av_warn_unused_result
 int swri_realloc_audio(AudioData *a, int count);
 
-void swri_noise_shaping_int16 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
-void swri_noise_shaping_int32 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
-void swri_noise_shaping_float (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
-void swri_noise_shaping_double(SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
+void swri_noise_shaping_int16 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count, int ch_start, int ch_end);
+void swri_noise_shaping_int32 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count, int ch_start, int ch_end);
+void swri_noise_shaping_float (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count, int ch_start, int ch_end);
+void swri_noise_shaping_double(SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count, int ch_start, int ch_end);
 
 av_warn_unused_result
 int swri_rematrix_init(SwrContext *s);
@@ -201,6 +213,9 @@ void swri_rematrix_free(SwrContext *s);
 int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mustcopy);
 int swri_rematrix_init_x86(struct SwrContext *s);
 
+int swri_thread_init(SwrContext *s);
+void swri_thread_free(SwrContext *s);
+
 av_warn_unused_result
 int swri_get_dither(SwrContext *s, void *dst, int len, unsigned seed, enum AVSampleFormat noise_fmt);
 av_warn_unused_result
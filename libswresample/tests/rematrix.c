@@ -0,0 +1,203 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Rematrix throughput benchmark: runs the standard downmixes with the s16,
+ * s32 and float internal formats, with the C and the SIMD mixing kernels,
+ * and compares the outputs of both.
+ * Usage: rematrix [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/channel_layout.h"
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/samplefmt.h"
+#include "libavutil/time.h"
+#include "libswresample/swresample.h"
+
+#define RATE  48000
+#define CHUNK 1024
+
+static const struct {
+    const char *name;
+    uint64_t in, out;
+} downmixes[] = {
+    { "5.1->stereo",       AV_CH_LAYOUT_5POINT1_BACK, AV_CH_LAYOUT_STEREO  },
+    { "5.1(side)->stereo", AV_CH_LAYOUT_5POINT1,      AV_CH_LAYOUT_STEREO  },
+    { "5.1->mono",         AV_CH_LAYOUT_5POINT1_BACK, AV_CH_LAYOUT_MONO    },
+    { "7.1->5.1",          AV_CH_LAYOUT_7POINT1,      AV_CH_LAYOUT_5POINT1 },
+    { "7.1->stereo",       AV_CH_LAYOUT_7POINT1,      AV_CH_LAYOUT_STEREO  },
+};
+
+static const enum AVSampleFormat formats[] = {
+    AV_SAMPLE_FMT_S16P,
+    AV_SAMPLE_FMT_S32P,
+    AV_SAMPLE_FMT_FLTP,
+};
+
+static double get_sample(const uint8_t *p, enum AVSampleFormat fmt, int i)
+{
+    switch (fmt) {
+    case AV_SAMPLE_FMT_S16P: return ((const int16_t *)p)[i] / 32768.0;
+    case AV_SAMPLE_FMT_S32P: return ((const int32_t *)p)[i] / 2147483648.0;
+    default:                 return ((const float   *)p)[i];
+    }
+}
+
+static void fill(uint8_t **data, enum AVSampleFormat fmt, int channels,
+                 int nb_samples, AVLFG *lfg)
+{
+    int ch, i;
+
+    /* quarter scale noise, so that the downmixes do not clip */
+    for (ch = 0; ch < channels; ch++) {
+        for (i = 0; i < nb_samples; i++) {
+            double v = ((int32_t)av_lfg_get(lfg)) / 8589934592.0;
+            switch (fmt) {
+            case AV_SAMPLE_FMT_S16P: ((int16_t *)data[ch])[i] = lrint(v * 32768);        break;
+            case AV_SAMPLE_FMT_S32P: ((int32_t *)data[ch])[i] = lrint(v * 2147483648.0); break;
+            default:                 ((float   *)data[ch])[i] = v;                       break;
+            }
+        }
+    }
+}
+
+static int run(enum AVSampleFormat fmt, uint64_t in_layout, uint64_t out_layout,
+               uint8_t **in, int nb_samples, uint8_t **out, int64_t *time)
+{
+    int in_ch  = av_get_channel_layout_nb_channels(in_layout);
+    int out_ch = av_get_channel_layout_nb_channels(out_layout);
+    struct SwrContext *swr;
+    const uint8_t *src[64];
+    uint8_t *dst[64];
+    int64_t t;
+    int pos, n, ch, ret;
+
+    swr = swr_alloc_set_opts(NULL, out_layout, fmt, RATE, in_layout, fmt, RATE, 0, NULL);
+    if (!swr)
+        return AVERROR(ENOMEM);
+    av_opt_set_sample_fmt(swr, "internal_sample_fmt", fmt, 0);
+    if ((ret = swr_init(swr)) < 0)
+        goto end;
+
+    t = av_gettime_relative();
+    for (pos = 0; pos < nb_samples; pos += n) {
+        n = FFMIN(CHUNK, nb_samples - pos);
+        for (ch = 0; ch < in_ch; ch++)
+            src[ch] = in[ch] + pos * av_get_bytes_per_sample(fmt);
+        for (ch = 0; ch < out_ch; ch++)
+            dst[ch] = out[ch] + pos * av_get_bytes_per_sample(fmt);
+        ret = swr_convert(swr, dst, n, src, n);
+        if (ret < 0)
+            goto end;
+        if (ret != n) {
+            ret = AVERROR_BUG;
+            goto end;
+        }
+    }
+    *time = av_gettime_relative() - t;
+    ret = 0;
+
+end:
+    swr_free(&swr);
+    return ret;
+}
+
+static void free_samples(uint8_t ***samples)
+{
+    if (*samples)
+        av_freep(&(*samples)[0]);
+    av_freep(samples);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds   = argc > 1 ? atoi(argv[1]) : 10;
+    int cpu_flags = av_get_cpu_flags();
+    int nb_samples, f, d, ch, i, ret = 0;
+    uint8_t **in = NULL, **out[2] = { NULL };
+    AVLFG lfg;
+
+    if (seconds <= 0) {
+        fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    nb_samples = seconds * RATE;
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    for (d = 0; d < FF_ARRAY_ELEMS(downmixes); d++) {
+        int in_ch  = av_get_channel_layout_nb_channels(downmixes[d].in);
+        int out_ch = av_get_channel_layout_nb_channels(downmixes[d].out);
+
+        for (f = 0; f < FF_ARRAY_ELEMS(formats); f++) {
+            enum AVSampleFormat fmt = formats[f];
+            int64_t time[2];
+            double max_diff = 0;
+
+            if (av_samples_alloc_array_and_samples(&in, NULL, in_ch, nb_samples, fmt, 0) < 0 ||
+                av_samples_alloc_array_and_samples(&out[0], NULL, out_ch, nb_samples, fmt, 0) < 0 ||
+                av_samples_alloc_array_and_samples(&out[1], NULL, out_ch, nb_samples, fmt, 0) < 0) {
+                ret = 1;
+                goto end;
+            }
+            fill(in, fmt, in_ch, nb_samples, &lfg);
+
+            /* the kernels are picked in swr_init() */
+            av_force_cpu_flags(0);
+            if (run(fmt, downmixes[d].in, downmixes[d].out, in, nb_samples, out[0], &time[0]) < 0) {
+                fprintf(stderr, "%s %s: conversion failed\n", downmixes[d].name, av_get_sample_fmt_name(fmt));
+                ret = 1;
+                goto end;
+            }
+            av_force_cpu_flags(cpu_flags);
+            if (run(fmt, downmixes[d].in, downmixes[d].out, in, nb_samples, out[1], &time[1]) < 0) {
+                fprintf(stderr, "%s %s: conversion failed\n", downmixes[d].name, av_get_sample_fmt_name(fmt));
+                ret = 1;
+                goto end;
+            }
+
+            for (ch = 0; ch < out_ch; ch++)
+                for (i = 0; i < nb_samples; i++)
+                    max_diff = FFMAX(max_diff, fabs(get_sample(out[0][ch], fmt, i) -
+                                                    get_sample(out[1][ch], fmt, i)));
+
+            printf("%-17s %-4s C: %7.1f Msamples/s  SIMD: %7.1f Msamples/s (%.2fx)  max diff %g\n",
+                   downmixes[d].name, av_get_sample_fmt_name(fmt),
+                   (double)nb_samples * in_ch / FFMAX(time[0], 1),
+                   (double)nb_samples * in_ch / FFMAX(time[1], 1),
+                   (double)time[0] / FFMAX(time[1], 1), max_diff);
+
+            free_samples(&in);
+            free_samples(&out[0]);
+            free_samples(&out[1]);
+        }
+    }
+
+end:
+    free_samples(&in);
+    free_samples(&out[0]);
+    free_samples(&out[1]);
+    return ret;
+}
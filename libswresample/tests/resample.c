@@ -0,0 +1,206 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Resampler throughput benchmark: converts noise from 44.1 to 48 kHz with
+ * every planar sample format, with the C and the SIMD filter kernels, and
+ * compares the outputs of both. The SIMD run uses the given number of threads.
+ * Usage: resample [channels [seconds [filter_size [threads]]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/channel_layout.h"
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/samplefmt.h"
+#include "libavutil/time.h"
+#include "libswresample/swresample.h"
+
+#define IN_RATE  44100
+#define OUT_RATE 48000
+#define CHUNK    1024
+
+static const enum AVSampleFormat formats[] = {
+    AV_SAMPLE_FMT_S16P,
+    AV_SAMPLE_FMT_S32P,
+    AV_SAMPLE_FMT_FLTP,
+    AV_SAMPLE_FMT_DBLP,
+};
+
+static double get_sample(const uint8_t *p, enum AVSampleFormat fmt, int i)
+{
+    switch (fmt) {
+    case AV_SAMPLE_FMT_S16P: return ((const int16_t *)p)[i] / 32768.0;
+    case AV_SAMPLE_FMT_S32P: return ((const int32_t *)p)[i] / 2147483648.0;
+    case AV_SAMPLE_FMT_FLTP: return ((const float   *)p)[i];
+    default:                 return ((const double  *)p)[i];
+    }
+}
+
+static void fill(uint8_t **data, enum AVSampleFormat fmt, int channels,
+                 int nb_samples, AVLFG *lfg)
+{
+    int ch, i;
+
+    /* half scale noise, so that the outputs rarely clip */
+    for (ch = 0; ch < channels; ch++) {
+        for (i = 0; i < nb_samples; i++) {
+            double v = ((int32_t)av_lfg_get(lfg)) / 4294967296.0;
+            switch (fmt) {
+            case AV_SAMPLE_FMT_S16P: ((int16_t *)data[ch])[i] = lrint(v * 32768);      break;
+            case AV_SAMPLE_FMT_S32P: ((int32_t *)data[ch])[i] = lrint(v * 2147483648.0); break;
+            case AV_SAMPLE_FMT_FLTP: ((float   *)data[ch])[i] = v;                     break;
+            default:                 ((double  *)data[ch])[i] = v;                     break;
+            }
+        }
+    }
+}
+
+/**
+ * Resample the whole input and return the number of output samples,
+ * or a negative error code.
+ */
+static int run(enum AVSampleFormat fmt, int linear, int filter_size,
+               int threads, int channels, uint8_t **in, int nb_in, uint8_t **out,
+               int out_size, int64_t *time)
+{
+    int64_t layout = av_get_default_channel_layout(channels);
+    struct SwrContext *swr;
+    int64_t t;
+    int done = 0, pos, n, ret = 0, ch;
+    const uint8_t *src[64];
+    uint8_t *dst[64];
+
+    swr = swr_alloc_set_opts(NULL, layout, fmt, OUT_RATE, layout, fmt, IN_RATE, 0, NULL);
+    if (!swr)
+        return AVERROR(ENOMEM);
+    av_opt_set_int(swr, "linear_interp", linear, 0);
+    av_opt_set_int(swr, "filter_size", filter_size, 0);
+    av_opt_set_int(swr, "threads", threads, 0);
+    if ((ret = swr_init(swr)) < 0)
+        goto end;
+
+    t = av_gettime_relative();
+    for (pos = 0; ; pos += n) {
+        n = FFMIN(CHUNK, nb_in - pos);
+        for (ch = 0; ch < channels; ch++) {
+            src[ch] = in[ch] + pos * av_get_bytes_per_sample(fmt);
+            dst[ch] = out[ch] + done * av_get_bytes_per_sample(fmt);
+        }
+        /* flush at the end */
+        ret = swr_convert(swr, dst, out_size - done, n ? src : NULL, n);
+        if (ret < 0)
+            goto end;
+        done += ret;
+        if (!n)
+            break;
+    }
+    *time = av_gettime_relative() - t;
+    ret = done;
+
+end:
+    swr_free(&swr);
+    return ret;
+}
+
+static void free_samples(uint8_t ***samples)
+{
+    if (*samples)
+        av_freep(&(*samples)[0]);
+    av_freep(samples);
+}
+
+int main(int argc, char **argv)
+{
+    int channels    = argc > 1 ? atoi(argv[1]) : 8;
+    int seconds     = argc > 2 ? atoi(argv[2]) : 10;
+    int filter_size = argc > 3 ? atoi(argv[3]) : 32;
+    int threads     = argc > 4 ? atoi(argv[4]) : 1;
+    int cpu_flags   = av_get_cpu_flags();
+    int nb_in, out_size, f, linear, ch, i, ret = 0;
+    uint8_t **in = NULL, **out[2] = { NULL };
+    AVLFG lfg;
+
+    if (channels <= 0 || channels > 64 || seconds <= 0 || filter_size <= 0 || threads < 0) {
+        fprintf(stderr, "Usage: %s [channels [seconds [filter_size [threads]]]]\n", argv[0]);
+        return 1;
+    }
+
+    nb_in    = seconds * IN_RATE;
+    out_size = av_rescale(nb_in, OUT_RATE, IN_RATE) + 2 * CHUNK;
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    printf("%d channels, %d s, filter size %d, %d threads\n",
+           channels, seconds, filter_size, threads);
+    for (f = 0; f < FF_ARRAY_ELEMS(formats); f++) {
+        enum AVSampleFormat fmt = formats[f];
+
+        if (av_samples_alloc_array_and_samples(&in, NULL, channels, nb_in, fmt, 0) < 0 ||
+            av_samples_alloc_array_and_samples(&out[0], NULL, channels, out_size, fmt, 0) < 0 ||
+            av_samples_alloc_array_and_samples(&out[1], NULL, channels, out_size, fmt, 0) < 0) {
+            ret = 1;
+            goto end;
+        }
+        fill(in, fmt, channels, nb_in, &lfg);
+
+        for (linear = 0; linear < 2; linear++) {
+            int64_t time[2];
+            int nb_out[2];
+            double max_diff = 0;
+
+            /* the kernels are picked in swr_init() */
+            av_force_cpu_flags(0);
+            nb_out[0] = run(fmt, linear, filter_size, 1, channels, in, nb_in,
+                            out[0], out_size, &time[0]);
+            av_force_cpu_flags(cpu_flags);
+            nb_out[1] = run(fmt, linear, filter_size, threads, channels, in, nb_in,
+                            out[1], out_size, &time[1]);
+            if (nb_out[0] < 0 || nb_out[1] < 0 || nb_out[0] != nb_out[1]) {
+                fprintf(stderr, "%s: conversion failed\n", av_get_sample_fmt_name(fmt));
+                ret = 1;
+                goto end;
+            }
+
+            for (ch = 0; ch < channels; ch++)
+                for (i = 0; i < nb_out[0]; i++)
+                    max_diff = FFMAX(max_diff, fabs(get_sample(out[0][ch], fmt, i) -
+                                                    get_sample(out[1][ch], fmt, i)));
+
+            printf("%-4s %-6s C: %7.1f Msamples/s  SIMD: %7.1f Msamples/s (%.2fx)  max diff %g\n",
+                   av_get_sample_fmt_name(fmt), linear ? "linear" : "common",
+                   (double)nb_in * channels / FFMAX(time[0], 1),
+                   (double)nb_in * channels / FFMAX(time[1], 1),
+                   (double)time[0] / FFMAX(time[1], 1), max_diff);
+        }
+
+        free_samples(&in);
+        free_samples(&out[0]);
+        free_samples(&out[1]);
+    }
+
+end:
+    free_samples(&in);
+    free_samples(&out[0]);
+    free_samples(&out[1]);
+    return ret;
+}
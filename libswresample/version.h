@@ -30,7 +30,7 @@
 
 #define LIBSWRESAMPLE_VERSION_MAJOR   2
 #define LIBSWRESAMPLE_VERSION_MINOR   4
-#define LIBSWRESAMPLE_VERSION_MICRO 100
+#define LIBSWRESAMPLE_VERSION_MICRO 102
 
 #define LIBSWRESAMPLE_VERSION_INT  AV_VERSION_INT(LIBSWRESAMPLE_VERSION_MAJOR, \
                                                   LIBSWRESAMPLE_VERSION_MINOR, \
@@ -0,0 +1,92 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+
+#include "libavcodec/hevcdsp.h"
+
+#include "checkasm.h"
+
+/* residuals are kept well inside the int16 range the decoder produces */
+#define randomize_coeffs(buf, size)             \
+    do {                                        \
+        int j;                                  \
+        for (j = 0; j < size; j++) {            \
+            int16_t r = rnd();                  \
+            AV_WN16A(buf + j, r >> 3);          \
+        }                                       \
+    } while (0)
+
+#define randomize_pixels(buf, size, mask)       \
+    do {                                        \
+        int j;                                  \
+        for (j = 0; j < size; j++)              \
+            buf[j] = rnd() & (mask);            \
+    } while (0)
+
+static void check_transform_add(HEVCDSPContext *h, int bit_depth)
+{
+    LOCAL_ALIGNED_32(int16_t,  coeffs0, [32 * 32]);
+    LOCAL_ALIGNED_32(int16_t,  coeffs1, [32 * 32]);
+    LOCAL_ALIGNED_32(uint16_t, dst0,    [32 * 32]);
+    LOCAL_ALIGNED_32(uint16_t, dst1,    [32 * 32]);
+    const int pixel_size = bit_depth > 8 ? 2 : 1;
+    int i;
+
+    declare_func_emms(AV_CPU_FLAG_MMX, void, uint8_t *dst, int16_t *coeffs, ptrdiff_t stride);
+
+    for (i = 0; i < 4; i++) {
+        int block_size = 4 << i;
+        ptrdiff_t stride = block_size * pixel_size;
+        int size = block_size * block_size;
+
+        if (check_func(h->transform_add[i], "hevc_transform_add%d_%d",
+                       block_size, bit_depth)) {
+            randomize_coeffs(coeffs0, size);
+            memcpy(coeffs1, coeffs0, sizeof(*coeffs0) * size);
+            if (pixel_size == 1) {
+                randomize_pixels(((uint8_t *)dst0), size, 0xFF);
+            } else {
+                randomize_pixels(dst0, size, (1 << bit_depth) - 1);
+            }
+            memcpy(dst1, dst0, size * pixel_size);
+
+            call_ref((uint8_t *)dst0, coeffs0, stride);
+            call_new((uint8_t *)dst1, coeffs1, stride);
+            if (memcmp(dst0, dst1, size * pixel_size))
+                fail();
+            bench_new((uint8_t *)dst1, coeffs1, stride);
+        }
+    }
+}
+
+void checkasm_check_hevc_add_res(void)
+{
+    int bit_depth;
+
+    for (bit_depth = 8; bit_depth <= 12; bit_depth += 2) {
+        HEVCDSPContext h;
+
+        ff_hevc_dsp_init(&h, bit_depth);
+        check_transform_add(&h, bit_depth);
+    }
+    report("transform_add");
+}
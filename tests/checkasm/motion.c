@@ -0,0 +1,88 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/internal.h"
+#include "libavutil/mem.h"
+
+#include "libavcodec/me_cmp.h"
+
+#include "checkasm.h"
+
+#define STRIDE 64
+#define BUF_SIZE (STRIDE * (16 + 2))
+
+#define randomize_buffer(buf)                   \
+    do {                                        \
+        int j;                                  \
+        for (j = 0; j < BUF_SIZE; j++)          \
+            buf[j] = rnd();                     \
+    } while (0)
+
+static void check_sad(me_cmp_func sad, const char *name, int width,
+                      uint8_t *cur, uint8_t *ref)
+{
+    /* 16 wide blocks are also used for field motion estimation,
+     * the 8x8 functions only ever get h = 8 */
+    static const int heights[] = { 16, 8 };
+    int i, x;
+
+    declare_func_emms(AV_CPU_FLAG_MMX, int, struct MpegEncContext *c,
+                      uint8_t *blk1, uint8_t *blk2, ptrdiff_t stride, int h);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(heights); i++) {
+        int h = heights[i];
+
+        if (h > width)
+            continue;
+        /* the current block is always aligned, the reference is not */
+        for (x = 0; x < 16; x += 5) {
+            if (check_func(sad, "%s_%dx%d", name, width, h)) {
+                int res0, res1;
+
+                randomize_buffer(cur);
+                randomize_buffer(ref);
+                res0 = call_ref(NULL, cur, ref + x + STRIDE, STRIDE, h);
+                res1 = call_new(NULL, cur, ref + x + STRIDE, STRIDE, h);
+                if (res0 != res1)
+                    fail();
+                bench_new(NULL, cur, ref + x + STRIDE, STRIDE, h);
+            }
+        }
+    }
+}
+
+void checkasm_check_motion(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, cur, [BUF_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, ref, [BUF_SIZE]);
+    AVCodecContext avctx = { 0 };
+    MECmpContext c;
+
+    ff_me_cmp_init(&c, &avctx);
+
+    check_sad(c.sad[0], "sad", 16, cur, ref);
+    check_sad(c.sad[1], "sad", 8,  cur, ref);
+    report("sad");
+
+    check_sad(c.pix_abs[0][0], "pix_abs", 16, cur, ref);
+    check_sad(c.pix_abs[1][0], "pix_abs", 8,  cur, ref);
+    report("pix_abs");
+}
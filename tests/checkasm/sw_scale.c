@@ -0,0 +1,189 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+
+#include "libswscale/swscale.h"
+#include "libswscale/swscale_internal.h"
+
+#include "checkasm.h"
+
+#define SRC_PIXELS       512
+#define DST_PIXELS       512
+#define MAX_FILTER_WIDTH 40
+#define MAX_VFILTER      16
+
+static const struct {
+    int bpc;
+    enum AVPixelFormat fmt;
+} sws_formats[] = {
+    {  8, AV_PIX_FMT_YUV420P   },
+    {  9, AV_PIX_FMT_YUV420P9  },
+    { 10, AV_PIX_FMT_YUV420P10 },
+    { 12, AV_PIX_FMT_YUV420P12 },
+    { 14, AV_PIX_FMT_YUV420P14 },
+    { 16, AV_PIX_FMT_YUV420P16 },
+};
+
+/* random taps summing to 1 << bits, like the normalized scaler filters */
+static void fill_filter(int16_t *filter, int size, int bits)
+{
+    int j, sum = 0;
+
+    for (j = 0; j < size - 1; j++) {
+        filter[j] = (int)(rnd() & 511) - 256;
+        sum      += filter[j];
+    }
+    filter[size - 1] = (1 << bits) - sum;
+}
+
+static void check_hscale(SwsContext *ctx)
+{
+    static const int filter_sizes[] = { 4, 8, 12, 16, MAX_FILTER_WIDTH };
+    LOCAL_ALIGNED_32(uint16_t, src,  [SRC_PIXELS + MAX_FILTER_WIDTH]);
+    LOCAL_ALIGNED_32(int32_t,  dst0, [DST_PIXELS]);
+    LOCAL_ALIGNED_32(int32_t,  dst1, [DST_PIXELS]);
+    /* padded past dstW like initFilter() does, the SIMD versions read it */
+    LOCAL_ALIGNED_32(int16_t,  filter,     [(DST_PIXELS + 3) * MAX_FILTER_WIDTH]);
+    LOCAL_ALIGNED_32(int32_t,  filter_pos, [DST_PIXELS + 3]);
+    int i, j, k, f;
+
+    declare_func(void, SwsContext *c, int16_t *dst, int dstW,
+                 const uint8_t *src, const int16_t *filter,
+                 const int32_t *filterPos, int filterSize);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(sws_formats); i++) {
+        const int bpc = sws_formats[i].bpc;
+
+        for (j = 0; j < 2; j++) {
+            const int dst_bits = j ? 19 : 15;
+
+            ctx->srcFormat = sws_formats[i].fmt;
+            ctx->srcBpc    = bpc;
+            ctx->dstFormat = j ? AV_PIX_FMT_YUV420P16 : AV_PIX_FMT_YUV420P;
+            ctx->dstBpc    = j ? 16 : 8;
+
+            for (f = 0; f < FF_ARRAY_ELEMS(filter_sizes); f++) {
+                const int width = filter_sizes[f];
+
+                ctx->hLumFilterSize = ctx->hChrFilterSize = width;
+                ff_getSwsFunc(ctx);
+
+                if (!check_func(ctx->hcScale, "hscale_%d_to_%d_width%d",
+                                bpc, dst_bits, width))
+                    continue;
+
+                for (k = 0; k < SRC_PIXELS + MAX_FILTER_WIDTH; k++)
+                    src[k] = bpc == 8 ? rnd() : rnd() & ((1 << bpc) - 1);
+                for (k = 0; k < DST_PIXELS; k++) {
+                    filter_pos[k] = rnd() % SRC_PIXELS;
+                    fill_filter(filter + k * width, width, 14);
+                }
+                for (; k < DST_PIXELS + 3; k++) {
+                    filter_pos[k] = filter_pos[DST_PIXELS - 1];
+                    memcpy(filter + k * width, filter + (DST_PIXELS - 1) * width,
+                           width * sizeof(*filter));
+                }
+                memset(dst0, 0, DST_PIXELS * sizeof(*dst0));
+                memset(dst1, 0, DST_PIXELS * sizeof(*dst1));
+
+                call_ref(ctx, (int16_t *)dst0, DST_PIXELS, (const uint8_t *)src,
+                         filter, filter_pos, width);
+                call_new(ctx, (int16_t *)dst1, DST_PIXELS, (const uint8_t *)src,
+                         filter, filter_pos, width);
+                if (memcmp(dst0, dst1, DST_PIXELS * (dst_bits == 15 ? 2 : 4)))
+                    fail();
+                bench_new(ctx, (int16_t *)dst1, DST_PIXELS, (const uint8_t *)src,
+                          filter, filter_pos, width);
+            }
+        }
+    }
+}
+
+static void check_yuv2planeX(SwsContext *ctx)
+{
+    static const int filter_sizes[] = { 2, 4, 8, MAX_VFILTER };
+    LOCAL_ALIGNED_32(int16_t, lines,  [MAX_VFILTER * DST_PIXELS]);
+    LOCAL_ALIGNED_32(int16_t, filter, [MAX_VFILTER]);
+    LOCAL_ALIGNED_32(uint8_t, dst0,   [DST_PIXELS * 2]);
+    LOCAL_ALIGNED_32(uint8_t, dst1,   [DST_PIXELS * 2]);
+    const int16_t *src[MAX_VFILTER];
+    uint8_t dither[8];
+    int i, j, k, f;
+
+    declare_func(void, const int16_t *filter, int filterSize,
+                 const int16_t **src, uint8_t *dest, int dstW,
+                 const uint8_t *dither, int offset);
+
+    for (k = 0; k < MAX_VFILTER; k++)
+        src[k] = lines + k * DST_PIXELS;
+
+    /* 8, 9 and 10-bit output */
+    for (i = 0; i < 3; i++) {
+        ctx->dstFormat = sws_formats[i].fmt;
+        ctx->dstBpc    = sws_formats[i].bpc;
+        ctx->dstW      = ctx->chrDstW = DST_PIXELS;
+        /* otherwise the MMX vertical scaler with its own filter layout is used */
+        ctx->flags     = SWS_ACCURATE_RND;
+        ff_getSwsFunc(ctx);
+
+        for (f = 0; f < FF_ARRAY_ELEMS(filter_sizes); f++) {
+            const int size = filter_sizes[f];
+
+            if (!check_func(ctx->yuv2planeX, "yuv2planeX_%d_%d",
+                            ctx->dstBpc, size))
+                continue;
+
+            for (k = 0; k < MAX_VFILTER * DST_PIXELS; k++)
+                lines[k] = rnd() & 0x7FFF;
+            for (k = 0; k < 8; k++)
+                dither[k] = rnd();
+            fill_filter(filter, size, 12);
+
+            for (j = 0; j < 2; j++) {
+                const int offset = j ? 3 : 0;
+
+                memset(dst0, 0, DST_PIXELS * 2);
+                memset(dst1, 0, DST_PIXELS * 2);
+                call_ref(filter, size, src, dst0, DST_PIXELS, dither, offset);
+                call_new(filter, size, src, dst1, DST_PIXELS, dither, offset);
+                if (memcmp(dst0, dst1, DST_PIXELS * (ctx->dstBpc > 8 ? 2 : 1)))
+                    fail();
+            }
+            bench_new(filter, size, src, dst1, DST_PIXELS, dither, 0);
+        }
+    }
+}
+
+void checkasm_check_sw_scale(void)
+{
+    SwsContext *ctx = sws_alloc_context();
+    if (!ctx)
+        return;
+
+    check_hscale(ctx);
+    report("hscale");
+
+    check_yuv2planeX(ctx);
+    report("yuv2planeX");
+
+    sws_freeContext(ctx);
+}
@@ -103,6 +103,14 @@ $(foreach MODE,$(FPMODES),$(eval $(call FATE_FPFILTER_SUITE,$(MODE))))
 FATE_FILTER_VSYNTH-$(CONFIG_FRAMEPACK_FILTER) += $(FATE_FILTER_FRAMEPACK)
 fate-filter-framepack: $(FATE_FILTER_FRAMEPACK)
 
+FATE_FILTER_VSYNTH-$(CONFIG_GEQ_FILTER) += fate-filter-geq-yuv
+fate-filter-geq-yuv: tests/data/filtergraphs/geq-yuv
+fate-filter-geq-yuv: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_script $(TARGET_PATH)/tests/data/filtergraphs/geq-yuv
+
+FATE_FILTER_VSYNTH-$(call ALLYES, FORMAT_FILTER GEQ_FILTER) += fate-filter-geq-rgb
+fate-filter-geq-rgb: tests/data/filtergraphs/geq-rgb
+fate-filter-geq-rgb: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_script $(TARGET_PATH)/tests/data/filtergraphs/geq-rgb
+
 FATE_FILTER_VSYNTH-$(CONFIG_GRADFUN_FILTER) += fate-filter-gradfun
 fate-filter-gradfun: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf gradfun
 
@@ -925,5 +925,16 @@ fate-swr-audioconvert: CMP = stddev
 fate-swr-audioconvert: FUZZ = 0
 
 FATE_SWR += $(FATE_SWR_AUDIOCONVERT-yes)
+
+# the threaded conversion must match the single threaded one, the channels
+# are split across the threads for resampling, rematrixing and dithering
+FATE_SWR_THREADS-$(call FILTERDEMDECENCMUX, ATRIM AFORMAT ARESAMPLE, WAV, PCM_S16LE, PCM_S16LE, FRAMECRC) += fate-swr-threads fate-swr-threads-4
+$(FATE_SWR_THREADS-yes): tests/data/asynth-44100-6.wav
+$(FATE_SWR_THREADS-yes): CMD = framecrc -i $(TARGET_PATH)/tests/data/asynth-44100-6.wav -af atrim=end_sample=10240,aformat=fltp,aresample=48000:threads=$(SWR_THREADS):dither_method=shibata,aformat=s16p:channel_layouts=quad
+fate-swr-threads:   SWR_THREADS = 1
+fate-swr-threads-4: SWR_THREADS = 4
+fate-swr-threads-4: REF = $(SRC_PATH)/tests/ref/fate/swr-threads
+
+FATE_SWR += $(FATE_SWR_THREADS-yes)
 FATE_FFMPEG += $(FATE_SWR)
 fate-swr: $(FATE_SWR)
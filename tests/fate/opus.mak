@@ -41,7 +41,25 @@ $(FATE_OPUS_CELT): CMP = oneoff
 $(FATE_OPUS_CELT): FUZZ = 6
 
 FATE_SAMPLES_AVCONV-$(call DEMDEC, MATROSKA, OPUS) += $(FATE_OPUS)
+
+# Round trip through the native encoder and decoder
+FATE_OPUS_ENCODE += fate-opus-encode
+fate-opus-encode: CMD = enc_dec_pcm ogg wav s16le $(REF) -c:a opus -strict experimental -b:a 256k
+
+FATE_OPUS_ENCODE += fate-opus-encode-fast
+fate-opus-encode-fast: CMD = enc_dec_pcm ogg wav s16le $(REF) -c:a opus -strict experimental -b:a 256k -compression_level 0
+
+$(FATE_OPUS_ENCODE): tests/data/asynth-48000-2.wav
+$(FATE_OPUS_ENCODE): REF = tests/data/asynth-48000-2.wav
+$(FATE_OPUS_ENCODE): CMP = stddev
+$(FATE_OPUS_ENCODE): CMP_SHIFT = -480
+$(FATE_OPUS_ENCODE): FUZZ = 25
+fate-opus-encode: CMP_TARGET = 2526
+fate-opus-encode-fast: CMP_TARGET = 2535
+
+FATE_OPUS_ENCODE-$(call ENCDEC, OPUS, OGG) += $(FATE_OPUS_ENCODE)
+FATE_FFMPEG += $(FATE_OPUS_ENCODE-yes)
 fate-opus-celt: $(FATE_OPUS_CELT)
 fate-opus-hybrid: $(FATE_OPUS_HYBRID)
 fate-opus-silk: $(FATE_OPUS_SILK)
-fate-opus: $(FATE_OPUS)
+fate-opus: $(FATE_OPUS) $(FATE_OPUS_ENCODE-yes)
@@ -449,6 +449,41 @@ $(FATE_VSYNTH3): tests/data/vsynth3.yuv
 FATE_AVCONV += $(FATE_VSYNTH1) $(FATE_VSYNTH2) $(FATE_VSYNTH3)
 FATE_SAMPLES_AVCONV += $(FATE_VSYNTH_LENA)
 
+# Threaded encodes that must match the single threaded encode, the
+# -threads variants share its reference. The slice threaded encoders are
+# given a fixed number of slices.
+ENC_THREADS_SRC1 = -f rawvideo -s 352x288 -pix_fmt yuv420p -i $(TARGET_PATH)/tests/data/vsynth1.yuv
+ENC_THREADS_SRC2 = -f rawvideo -s 352x288 -pix_fmt yuv420p -i $(TARGET_PATH)/tests/data/vsynth2.yuv
+
+FATE_ENC_THREADS-$(call ALLYES, RAWVIDEO_DEMUXER MPEG4_ENCODER FRAMECRC_MUXER) += mpeg4-b_strategy2
+fate-mpeg4-b_strategy2 fate-mpeg4-b_strategy2-threads: ENCOPTS = $(ENC_THREADS_SRC1) -c:v mpeg4 -qscale 10 -bf 2 -b_strategy 2 -slices 4
+
+# a cut from vsynth1 to vsynth2 that only the lookahead can detect
+FATE_ENC_THREADS-$(call ALLYES, RAWVIDEO_DEMUXER TRIM_FILTER CONCAT_FILTER MPEG2VIDEO_ENCODER FRAMECRC_MUXER) += mpeg2-rc_lookahead
+fate-mpeg2-rc_lookahead fate-mpeg2-rc_lookahead-threads: ENCOPTS = $(ENC_THREADS_SRC1) $(ENC_THREADS_SRC2) \
+    -filter_complex "[0:v]trim=end_frame=12[a]\;[1:v]trim=end_frame=12[b]\;[a][b]concat"  \
+    -c:v mpeg2video -b:v 1500k -maxrate 1500k -bufsize 1000k -bf 2 -rc_lookahead 8 -sc_threshold 1000000000 -slices 4
+
+# macroblock rows of the motion estimation are pulled by the slice threads
+FATE_ENC_THREADS-$(call ALLYES, RAWVIDEO_DEMUXER MPEG4_ENCODER FRAMECRC_MUXER) += mpeg4-me_rows
+fate-mpeg4-me_rows fate-mpeg4-me_rows-threads: ENCOPTS = $(ENC_THREADS_SRC1) -c:v mpeg4 -qscale 8 -flags +mv4 -cmp 2 -subcmp 2 -bf 2 -slices 4
+
+# intra-only FFV1 is encoded with frame threads
+FATE_ENC_THREADS-$(call ALLYES, RAWVIDEO_DEMUXER FFV1_ENCODER FRAMECRC_MUXER) += ffv1-intra
+fate-ffv1-intra fate-ffv1-intra-threads: ENCOPTS = $(ENC_THREADS_SRC1) -c:v ffv1 -g 1
+
+FATE_ENC_THREADS_MT = $(FATE_ENC_THREADS-yes:%=fate-%-threads)
+FATE_ENC_THREADS    = $(FATE_ENC_THREADS-yes:%=fate-%) $(FATE_ENC_THREADS_MT)
+
+$(FATE_ENC_THREADS): tests/data/vsynth1.yuv tests/data/vsynth2.yuv
+$(FATE_ENC_THREADS): CMD = framecrc $(ENCOPTS) -dct fastint -idct simple -threads $(ENC_THREADS)
+$(FATE_ENC_THREADS): ENC_THREADS = 1
+$(FATE_ENC_THREADS_MT): ENC_THREADS = 4
+$(FATE_ENC_THREADS_MT): REF = $(SRC_PATH)/tests/ref/fate/$(@:fate-%-threads=%)
+
+FATE_AVCONV += $(FATE_ENC_THREADS)
+fate-enc-threads: $(FATE_ENC_THREADS)
+
 fate-vsynth1: $(FATE_VSYNTH1)
 fate-vsynth2: $(FATE_VSYNTH2)
 fate-vsynth_lena: $(FATE_VSYNTH_LENA)